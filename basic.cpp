@@ -1,7 +1,64 @@
 #include "DBReflectionHelper.h"
+#include "KeysetPager.h"
+#include "db_filters.h"
+#include "db_export.h"
+#include "StaticQuery.h"
+#include "Insert.h"
+#include "IndexAdvisor.h"
+#include "Router.h"
 #define BOOST_TEST_MODULE DatabaseBasic
 #include <boost/test/unit_test.hpp>
 #include <boost/range/irange.hpp>
+#include <sstream>
+#include <stdexcept>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+struct AccountRow {
+    long long id;
+    std::string name;
+    double balance;
+};
+DB_ROW_MAPPING(AccountRow, (id)(name)(balance))
+
+DB_STATIC_TABLE(AccountsTable, "Accounts");
+DB_STATIC_TABLE(UsersTable, "Users");
+DB_STATIC_COLUMN(AccountId, AccountsTable, "id", Poco::Int64);
+DB_STATIC_COLUMN(AccountName, AccountsTable, "name", std::string);
+DB_STATIC_COLUMN(AccountUser, AccountsTable, "user_id", Poco::Int64);
+DB_STATIC_COLUMN(UserId, UsersTable, "id", Poco::Int64);
+
+/**
+ * Temporary database file with known tables and rows, removed after the test
+ */
+struct TestDatabase {
+    TestDatabase()
+    {
+        char path[] = "/tmp/db_test_XXXXXX";
+        const int fd = mkstemp(path);
+        BOOST_REQUIRE(fd >= 0);
+        close(fd);
+        db_name = path;
+        auto connection = DB::SessionPool::get(db_name)->acquire();
+        for(const auto &sql : {
+                "CREATE TABLE Users (id INTEGER PRIMARY KEY, name TEXT);",
+                "CREATE TABLE Accounts (id INTEGER PRIMARY KEY, user_id INTEGER, name TEXT, balance REAL, type INTEGER);",
+                "INSERT INTO Users VALUES (1, 'ann'), (2, 'bob');",
+                "INSERT INTO Accounts VALUES (1, 1, 'alpha', 10.5, 1), (2, 1, 'beta', NULL, 2), (3, 2, 'gamma', -3.25, 1), "
+                    "(4, 2, '', 0, 2), (5, NULL, NULL, 7, 'n/a');"})
+            connection->session << sql, Poco::Data::now;
+    }
+
+    ~TestDatabase()
+    {
+        DB::SessionPool::shutdown_all();
+        DB::SchemaCache::invalidate(db_name);
+        std::remove(db_name.c_str());
+    }
+
+    std::string db_name;
+};
 
 BOOST_AUTO_TEST_SUITE(DbSelectSuite)
 
@@ -26,6 +83,18 @@ BOOST_AUTO_TEST_CASE(testInitMultiple)
         DB::Select::factory();
 }
 
+BOOST_AUTO_TEST_CASE(testPoolReusesSessions)
+{
+    auto pool = DB::SessionPool::get("main.db");
+    const auto before = pool->stats();
+    for(auto i : boost::irange(0, 10))
+        DB::Select::factory();
+    const auto after = pool->stats();
+    BOOST_CHECK_EQUAL(after.misses, before.misses);
+    BOOST_CHECK_EQUAL(after.hits - before.hits, 10u);
+    BOOST_CHECK_EQUAL(after.used, 0u);
+}
+
 BOOST_AUTO_TEST_CASE(innerJoinInitStrings)
 {
     auto v = DB::Join(DB::JOIN::INNER, "Accounts", "Konta", "id", "account_id");
@@ -50,6 +119,636 @@ BOOST_AUTO_TEST_CASE(outerJoinInit)
     BOOST_CHECK_EQUAL(v.get_string(), "LEFT OUTER JOIN Accounts ON id = account_id");
 }
 
+BOOST_AUTO_TEST_CASE(normalizeLiterals)
+{
+    auto shape = DB::normalize("SELECT * FROM `t` WHERE name='O''Brien' AND id>10 AND x<1.5e3 ORDER BY 2 LIMIT 5;");
+    BOOST_CHECK_EQUAL(shape.text, "SELECT * FROM `t` WHERE name=? AND id>? AND x<? ORDER BY 2 LIMIT ?;");
+    BOOST_REQUIRE_EQUAL(shape.params.size(), 4u);
+    BOOST_CHECK_EQUAL(shape.params[0].as_text(), "O'Brien");
+    BOOST_CHECK_EQUAL(shape.params[1].as_int(), 10);
+    BOOST_CHECK_EQUAL(shape.params[2].as_real(), 1500.0);
+    BOOST_CHECK_EQUAL(shape.params[3].as_int(), 5);
+}
+
+BOOST_AUTO_TEST_CASE(normalizeKeepsIdentifiers)
+{
+    auto shape = DB::normalize("SELECT col1, \"2nd\" FROM t2 WHERE a=? AND b=3", {DB::Param(7)});
+    BOOST_CHECK_EQUAL(shape.text, "SELECT col1, \"2nd\" FROM t2 WHERE a=? AND b=?");
+    BOOST_REQUIRE_EQUAL(shape.params.size(), 2u);
+    BOOST_CHECK_EQUAL(shape.params[0].as_int(), 7);
+    BOOST_CHECK_EQUAL(shape.params[1].as_int(), 3);
+
+    // Zero-prefixed numbers are decimal, aliases and type arguments are not values
+    shape = DB::normalize("SELECT CAST(a AS VARCHAR (10)) AS 'x', 0x1A FROM t WHERE id = 010 AND b = 09");
+    BOOST_CHECK_EQUAL(shape.text, "SELECT CAST(a AS VARCHAR (10)) AS 'x', ? FROM t WHERE id = ? AND b = ?");
+    BOOST_REQUIRE_EQUAL(shape.params.size(), 3u);
+    BOOST_CHECK_EQUAL(shape.params[0].as_int(), 26);
+    BOOST_CHECK_EQUAL(shape.params[1].as_int(), 10);
+    BOOST_CHECK_EQUAL(shape.params[2].as_int(), 9);
+}
+
+BOOST_AUTO_TEST_CASE(paramTypes)
+{
+    BOOST_CHECK(DB::Param(5).type() == DB::Param::TYPE::INTEGER);
+    BOOST_CHECK(DB::Param(5ul).type() == DB::Param::TYPE::INTEGER);
+    BOOST_CHECK(DB::Param(2.5).type() == DB::Param::TYPE::REAL);
+    BOOST_CHECK(DB::Param(std::string("abc")).type() == DB::Param::TYPE::TEXT);
+    BOOST_CHECK_EQUAL(DB::Param(Poco::DateTime(2014, 3, 7, 12, 5, 9)).as_text(), "2014-03-07 12:05:09");
+}
+
+BOOST_AUTO_TEST_CASE(boundWhereOverloads)
+{
+    const auto query = DB::Select::factory("Accounts")
+        .where("id", "=", 5)
+        .and_where("name", "LIKE", DB::Param(std::string("a%")))
+        .or_where("balance", ">", 2.5)
+        .where("id", "10")
+        .limit(10, 20).compile();
+    BOOST_CHECK_EQUAL(query.sql(), "SELECT * FROM `Accounts`  WHERE id = ? AND name LIKE ? OR balance > ? OR id=? LIMIT ? OFFSET ?;");
+    const auto &params = query.params();
+    BOOST_REQUIRE_EQUAL(params.size(), 6u);
+    BOOST_CHECK(params[0].type() == DB::Param::TYPE::INTEGER);
+    BOOST_CHECK_EQUAL(params[0].as_int(), 5);
+    BOOST_CHECK(params[1].type() == DB::Param::TYPE::TEXT);
+    BOOST_CHECK_EQUAL(params[1].as_text(), "a%");
+    BOOST_CHECK(params[2].type() == DB::Param::TYPE::REAL);
+    BOOST_CHECK_EQUAL(params[2].as_real(), 2.5);
+    BOOST_CHECK(params[3].type() == DB::Param::TYPE::INTEGER);
+    BOOST_CHECK_EQUAL(params[3].as_int(), 10);
+    BOOST_CHECK_EQUAL(params[4].as_int(), 10);
+    BOOST_CHECK_EQUAL(params[5].as_int(), 20);
+}
+
+BOOST_AUTO_TEST_CASE(columnarDataAccess)
+{
+    DB::ColumnarData data({"id", "ratio", "name"},
+        {DB::ColumnVector::TYPE::INTEGER, DB::ColumnVector::TYPE::REAL, DB::ColumnVector::TYPE::TEXT});
+    data.push_int(0, 7);
+    data.push_real(1, 0.5);
+    data.push_text(2, "abc");
+    data.push_null(0);
+    data.push_null(1);
+    data.push_text(2, "de");
+    BOOST_CHECK_EQUAL(data.rows(), 2u);
+    BOOST_CHECK_EQUAL(data.column("id").get_int(0), 7);
+    BOOST_CHECK(data.column(0).is_null(1));
+    BOOST_CHECK_EQUAL(data.get(1, "ratio"), "");
+    BOOST_CHECK_EQUAL(data.get(0, 1), "0.5");
+    BOOST_CHECK_EQUAL(data.column(2).get_text(1), "de");
+    BOOST_CHECK_THROW(data.index("missing"), Poco::NotFoundException);
+}
+
+BOOST_FIXTURE_TEST_CASE(columnarMixedTypes, TestDatabase)
+{
+    const auto data = DB::Select::factory("Accounts", db_name).columns("id").columns("balance").columns("type").order_by("id").get_columnar();
+    BOOST_REQUIRE_EQUAL(data.rows(), 5u);
+    BOOST_CHECK(data.column("id").type() == DB::ColumnVector::TYPE::INTEGER);
+    BOOST_CHECK(data.column("balance").type() == DB::ColumnVector::TYPE::REAL);
+    BOOST_CHECK(data.column("balance").is_null(1));
+    BOOST_CHECK_EQUAL(data.column("balance").get_real(2), -3.25);
+    // Text in INTEGER column moves the whole column to TEXT storage
+    BOOST_CHECK(data.column("type").type() == DB::ColumnVector::TYPE::TEXT);
+    BOOST_CHECK_EQUAL(data.get(0, "type"), "1");
+    BOOST_CHECK_EQUAL(data.get(4, "type"), "n/a");
+    BOOST_CHECK_EQUAL(data.column("type").get_int(4), 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(cursorBindsParams, TestDatabase)
+{
+    auto select = DB::Select::factory("Accounts", db_name);
+    select.columns("id").columns("name").where("user_id", "=", 1).or_where("name", "=", DB::Param(std::string("gamma")))
+        .or_where("balance", "=", 7.0).order_by("id");
+    std::vector<std::string> names;
+    // Chunks of 2 rows, so the statement is stepped more than once
+    BOOST_CHECK_EQUAL(select.stream([&](const DB::Row &row) { names.push_back(row.at("name")); return true; }, 2), 4u);
+    BOOST_CHECK_EQUAL(names.size(), 4u);
+    BOOST_CHECK((names == std::vector<std::string>{"alpha", "beta", "gamma", ""}));
+    std::string ids;
+    for(const auto &row : select.rows(1))
+        ids += row.at("id");
+    BOOST_CHECK_EQUAL(ids, "1235");
+}
+
+BOOST_FIXTURE_TEST_CASE(schemaCacheInvalidation, TestDatabase)
+{
+    auto connection = DB::SessionPool::get(db_name)->acquire();
+    DB::SchemaCache::set_check_interval(std::chrono::hours(1));
+    BOOST_CHECK_EQUAL(DB::SchemaCache::get(*connection, db_name, "Accounts").names.size(), 5u);
+    connection->session << "ALTER TABLE Accounts ADD COLUMN note TEXT;", Poco::Data::now;
+    // Entry is not checked again before the interval passes
+    BOOST_CHECK_EQUAL(DB::SchemaCache::get(*connection, db_name, "Accounts").names.size(), 5u);
+    DB::SchemaCache::invalidate(db_name, "Accounts");
+    const auto info = DB::SchemaCache::get(*connection, db_name, "Accounts");
+    BOOST_REQUIRE_EQUAL(info.names.size(), 6u);
+    BOOST_CHECK_EQUAL(info.names.back(), "note");
+    BOOST_CHECK_EQUAL(info.types.back(), "TEXT");
+
+    // Changed schema_version is noticed on the next check
+    DB::SchemaCache::set_check_interval(std::chrono::milliseconds(0));
+    connection->session << "ALTER TABLE Accounts ADD COLUMN created INTEGER;", Poco::Data::now;
+    BOOST_CHECK_EQUAL(DB::SchemaCache::get(*connection, db_name, "Accounts").names.size(), 7u);
+    BOOST_CHECK_EQUAL(DB::Select::factory("Accounts", db_name).get().front().count("created"), 1u);
+
+    // Columns of stale entry are selected by name, so values still match them after the table is re-created
+    DB::SchemaCache::set_check_interval(std::chrono::hours(1));
+    connection->session << "CREATE TABLE Pairs (a INTEGER, b TEXT);", Poco::Data::now;
+    auto pairs = DB::Select::factory("Pairs", db_name);
+    BOOST_CHECK_EQUAL(pairs.compile().sql(), "SELECT `Pairs`.`a`, `Pairs`.`b` FROM `Pairs` ;");
+    connection->session << "DROP TABLE Pairs;", Poco::Data::now;
+    connection->session << "CREATE TABLE Pairs (b TEXT, a INTEGER);", Poco::Data::now;
+    connection->session << "INSERT INTO Pairs VALUES ('x', 1);", Poco::Data::now;
+    const auto rows = DB::Select::factory("Pairs", db_name).get();
+    BOOST_REQUIRE_EQUAL(rows.size(), 1u);
+    BOOST_CHECK_EQUAL(rows[0].at("a"), "1");
+    BOOST_CHECK_EQUAL(rows[0].at("b"), "x");
+    DB::SchemaCache::set_check_interval(std::chrono::seconds(1));
+}
+
+BOOST_FIXTURE_TEST_CASE(asyncExecutorResults, TestDatabase)
+{
+    DB::AsyncExecutor executor(4, 8);
+    std::vector<std::future<DB::Data>> results;
+    for(auto i : boost::irange(0, 20))
+        results.push_back(executor.submit(db_name, DB::Select::factory("Accounts", db_name).columns("name").where("id", "=", i % 5 + 1).compile()));
+    results.push_back(executor.submit(db_name, DB::Select::factory("Missing", db_name).columns("id").compile()));
+    std::promise<std::exception_ptr> callback_error;
+    executor.submit(db_name, DB::Select::factory("Missing", db_name).columns("id").compile(),
+        [&](const DB::Data&, std::exception_ptr error) { callback_error.set_value(error); });
+
+    for(std::size_t i = 0; i < 20; ++i)
+    {
+        const auto rows = results[i].get();
+        BOOST_REQUIRE_EQUAL(rows.size(), 1u);
+        if(i % 5 == 0)
+            BOOST_CHECK_EQUAL(rows.front().at("name"), "alpha");
+    }
+    BOOST_CHECK_THROW(results.back().get(), Poco::Exception);
+    BOOST_CHECK(callback_error.get_future().get() != nullptr);
+    // Throwing callback doesn't stop its worker
+    DB::AsyncExecutor single(1, 2);
+    single.submit(db_name, DB::Select::factory("Accounts", db_name).columns("id").compile(),
+        [](const DB::Data&, std::exception_ptr) { throw std::runtime_error("callback failed"); });
+    BOOST_CHECK_EQUAL(single.submit(db_name, DB::Select::factory("Accounts", db_name).columns("id").compile()).get().size(), 5u);
+    // Sessions went back to the pool, which never opened more than its limit
+    const auto stats = DB::SessionPool::get(db_name)->stats();
+    BOOST_CHECK_EQUAL(stats.used, 0u);
+    BOOST_CHECK_LE(stats.idle, DB::SessionPool::Config().max_size);
+}
+
+BOOST_FIXTURE_TEST_CASE(parallelGetMergesShards, TestDatabase)
+{
+    DB::AsyncExecutor executor(3, 8);
+    const auto ids = [](const DB::Data &rows) {
+        std::string res;
+        for(const auto &row : rows)
+            res += row.at("id") + ',';
+        return res;
+    };
+    auto select = DB::Select::factory("Accounts", db_name);
+    // Shards [1, 3), [3, 5), [5, ...): NULL name (5) sorts before empty name (4) from another shard
+    select.columns("id").columns("name").order_by("name").order_by("id");
+    BOOST_CHECK_EQUAL(ids(select.parallel_get(executor, 3, "id")), "5,4,1,2,3,");
+    select.clear().columns("id").columns("balance").order_by("balance", DB::ORDER::DESC);
+    BOOST_CHECK_EQUAL(ids(select.parallel_get(executor, 3, "id")), "1,5,4,3,2,");
+    // Shard conditions don't stay in the builder
+    BOOST_CHECK_EQUAL(select.compile().sql(), "SELECT id, balance FROM `Accounts`  ORDER BY balance DESC;");
+    BOOST_CHECK_EQUAL(DB::SessionPool::get(db_name)->stats().used, 1u);
+    BOOST_CHECK_THROW(select.parallel_get(executor, 3, "balance"), Poco::InvalidArgumentException);
+    select.clear().columns("id").columns("name").order_by("name COLLATE NOCASE");
+    BOOST_CHECK_THROW(select.parallel_get(executor, 3, "id"), Poco::InvalidArgumentException);
+
+    // Text which looks like numbers is still compared as text, keys may span whole Int64 range
+    auto connection = DB::SessionPool::get(db_name)->acquire();
+    connection->session << "CREATE TABLE Words (id INTEGER PRIMARY KEY, word TEXT);", Poco::Data::now;
+    connection->session << "INSERT INTO Words VALUES (-9223372036854775808, '10'), (-5, '9'), (0, 'nan'), (1, 'inf'), "
+        "(2, ' 12'), (9223372036854775806, '0x1A'), (9223372036854775807, NULL);", Poco::Data::now;
+    connection.reset();
+    auto words = DB::Select::factory("Words", db_name);
+    words.columns("word").columns("id").order_by("word");
+    std::string sorted;
+    for(const auto &row : words.parallel_get(executor, 3, "id"))
+        sorted += row.at("word") + '|';
+    BOOST_CHECK_EQUAL(sorted, "| 12|0x1A|10|9|inf|nan|");
+    words.clear().columns("id").order_by("id", DB::ORDER::DESC);
+    BOOST_CHECK_EQUAL(ids(words.parallel_get(executor, 4, "id")),
+        "9223372036854775807,9223372036854775806,2,1,0,-5,-9223372036854775808,");
+}
+
+BOOST_AUTO_TEST_CASE(rowMappingColumns)
+{
+    const auto cols = DB::RowMapping<AccountRow>::columns();
+    BOOST_REQUIRE_EQUAL(cols.size(), 3u);
+    BOOST_CHECK_EQUAL(cols[0], "id");
+    BOOST_CHECK_EQUAL(cols[2], "balance");
+    BOOST_CHECK_EQUAL(Poco::Data::TypeHandler<AccountRow>::size(), 3u);
+    BOOST_CHECK_EQUAL((Poco::Data::TypeHandler<std::tuple<int, std::string>>::size()), 2u);
+}
+
+BOOST_AUTO_TEST_CASE(compileIsRepeatable)
+{
+    auto select = DB::Select::factory("Accounts");
+    select.columns("id").columns("name", "Nazwa")
+        .join(DB::Join(DB::JOIN::INNER, "Users", "Users.id", "Accounts.user_id"))
+        .where("id", "=", 5).and_where("name", "LIKE", DB::Param(std::string("a%")))
+        .limit(10);
+    const auto first = select.compile();
+    const auto second = select.compile();
+    BOOST_CHECK_EQUAL(first.sql(), "SELECT id, name AS `Nazwa` FROM `Accounts` JOIN Users ON Users.id = Accounts.user_id "
+        " WHERE id = ? AND name LIKE ? LIMIT ?;");
+    BOOST_CHECK_EQUAL(first.sql(), second.sql());
+    BOOST_CHECK_EQUAL(second.params().size(), 3u);
+    BOOST_CHECK_EQUAL(second.cols().size(), 2u);
+}
+
+BOOST_AUTO_TEST_CASE(seekAfterLastKeys)
+{
+    auto select = DB::Select::factory("Accounts");
+    select.columns("id").columns("name").where("id", "=", 5).or_where("id", "=", 7)
+        .order_by(std::vector<std::string>{"name", "id"}).seek({DB::Param(std::string("b")), DB::Param(7)}).limit(10);
+    const auto query = select.compile();
+    BOOST_CHECK_EQUAL(query.sql(), "SELECT id, name FROM `Accounts`  WHERE (id = ? OR id = ?) AND (name, id) > (?, ?)"
+        " ORDER BY name ASC, id ASC LIMIT ?;");
+    BOOST_CHECK_EQUAL(query.params().at(2).as_text(), "b");
+    BOOST_CHECK_EQUAL(query.params().at(3).as_int(), 7);
+    select.clear().columns("id").order_by("id", DB::ORDER::DESC).seek({DB::Param(3)});
+    BOOST_CHECK_EQUAL(select.compile().sql(), "SELECT id FROM `Accounts`  WHERE (id < ? OR id IS NULL) ORDER BY id DESC;");
+    select.clear().columns("id").columns("name").order_by("name", DB::ORDER::DESC).order_by("id").seek({DB::Param(), DB::Param(4)});
+    const auto after_null = select.compile();
+    BOOST_CHECK_EQUAL(after_null.sql(), "SELECT id, name FROM `Accounts`  WHERE ((name IS NULL AND id > ?)) ORDER BY name DESC, id ASC;");
+    BOOST_REQUIRE_EQUAL(after_null.params().size(), 1u);
+    BOOST_CHECK_EQUAL(after_null.params().at(0).as_int(), 4);
+}
+
+BOOST_FIXTURE_TEST_CASE(keysetPagerNullKeys, TestDatabase)
+{
+    const auto read = [](DB::KeysetPager &pager) {
+        std::string ids;
+        while(pager.next())
+            for(const auto &row : pager.page())
+                ids += row.at("id") + ',';
+        return ids;
+    };
+    auto select = DB::Select::factory("Accounts", db_name);
+    select.columns("id").columns("name").order_by("name").order_by("id");
+    // NULL name sorts first, empty name right after it
+    DB::KeysetPager ascending(select, 1);
+    BOOST_REQUIRE(ascending.next());
+    BOOST_CHECK(ascending.last_key().at(0).is_null());
+    BOOST_CHECK(ascending.last_key().at(1).type() == DB::Param::TYPE::INTEGER);
+    BOOST_CHECK_EQUAL(read(ascending.resume(ascending.last_key())), "4,1,2,3,");
+    select.clear().columns("id").columns("name").order_by("name", DB::ORDER::DESC).order_by("id");
+    DB::KeysetPager descending(select, 2);
+    BOOST_CHECK_EQUAL(read(descending), "3,2,1,4,5,");
+    select.clear().columns("id").columns("balance").order_by("balance", DB::ORDER::DESC).order_by("id");
+    DB::KeysetPager reals(select, 2);
+    BOOST_CHECK_EQUAL(read(reals), "1,5,4,3,2,");
+    select.limit(1, 3);
+    DB::KeysetPager limited(select, 3);
+    BOOST_CHECK_EQUAL(read(limited), "1,5,4,3,2,");
+    BOOST_CHECK_EQUAL(select.clear_limit().clear_offset().compile().sql(),
+        "SELECT id, balance FROM `Accounts`  ORDER BY balance DESC, id ASC;");
+}
+
+BOOST_AUTO_TEST_CASE(aggregatesWithHaving)
+{
+    auto select = DB::Select::factory("Accounts");
+    select.columns("user_id").count().sum("Accounts.balance").group_concat("name", "; ")
+        .where("balance", ">", 1).group_by(std::vector<std::string>{"user_id", "type"})
+        .having("count", ">", 2).having(DB::WHERE::OR, "sum_balance", "<", DB::Param(100.0)).order_by("sum_balance");
+    const auto query = select.compile();
+    BOOST_CHECK_EQUAL(query.sql(), "SELECT user_id, COUNT(*) AS `count`, SUM(Accounts.balance) AS `sum_balance`, "
+        "GROUP_CONCAT(name, ?) AS `group_concat_name` FROM `Accounts`  WHERE balance > ? GROUP BY user_id, type "
+        "HAVING count > ? OR sum_balance < ? ORDER BY sum_balance ASC;");
+    BOOST_CHECK_EQUAL(query.params().size(), 4u);
+    BOOST_CHECK_EQUAL(query.params().at(0).as_text(), "; ");
+    BOOST_CHECK_EQUAL(query.params().at(2).as_int(), 2);
+    BOOST_CHECK_EQUAL(query.cols().at(3), "group_concat_name");
+}
+
+BOOST_AUTO_TEST_CASE(indexAdvisorCandidate)
+{
+    auto select = DB::Select::factory("Accounts");
+    select.columns("Accounts.id").columns("balance").join(DB::Join(DB::JOIN::INNER, "Users", "Users.id", "Accounts.user_id"))
+        .where("type", "=", 2).and_where("created", ">", 100).order_by("name").order_by("id", DB::ORDER::DESC);
+    BOOST_CHECK_EQUAL(select.order_keys().size(), 2u);
+    const auto usage = DB::IndexAdvisor::usage(select);
+    bool covering = false;
+    const auto index = DB::IndexAdvisor::candidate(usage, covering);
+    BOOST_CHECK(covering);
+    BOOST_CHECK_EQUAL(DB::IndexAdvisor::ddl(usage.table, index), "CREATE INDEX IF NOT EXISTS `idx_Accounts_type_name_id_desc_created_balance_user_id` "
+        "ON `Accounts` (`type`, `name`, `id` DESC, `created`, `balance`, `user_id`);");
+
+    DB::IndexAdvisor advisor;
+    advisor.add(select);
+    advisor.add(select.clear().columns("name"));
+    const auto advice = advisor.advise();
+    BOOST_CHECK_EQUAL(advice.size(), 2u);
+    BOOST_CHECK( ! advice.front().ddl.empty());
+    BOOST_CHECK(advice.back().index.empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(indexAdvisorExistingIndexes, TestDatabase)
+{
+    auto connection = DB::SessionPool::get(db_name)->acquire();
+    connection->session << "CREATE INDEX idx_same ON Accounts (name, id);", Poco::Data::now;
+    connection->session << "CREATE INDEX idx_partial ON Accounts (name, id DESC) WHERE type = 1;", Poco::Data::now;
+    auto select = DB::Select::factory("Accounts", db_name);
+    select.columns("id").columns("name").order_by("name").order_by("id", DB::ORDER::DESC);
+    DB::IndexAdvisor advisor(db_name);
+    advisor.add(select);
+    // Neither the index with other directions nor the partial one can serve the sort
+    auto advice = advisor.advise();
+    BOOST_REQUIRE_EQUAL(advice.size(), 1u);
+    BOOST_CHECK(advice.front().existing.empty());
+    BOOST_CHECK_EQUAL(advice.front().ddl, "CREATE INDEX IF NOT EXISTS `idx_Accounts_name_id_desc` ON `Accounts` (`name`, `id` DESC);");
+    // Index with all directions opposite is read backwards
+    connection->session << "CREATE INDEX idx_reversed ON Accounts (name DESC, id);", Poco::Data::now;
+    advice = advisor.advise();
+    BOOST_REQUIRE_EQUAL(advice.size(), 1u);
+    BOOST_CHECK_EQUAL(advice.front().existing, "idx_reversed");
+    BOOST_CHECK(advice.front().ddl.empty());
+}
+
+BOOST_AUTO_TEST_CASE(attachedTablesAndReplicas)
+{
+    BOOST_CHECK_EQUAL(DB::SchemaCache::quote("archive.Accounts"), "`archive`.`Accounts`");
+    BOOST_CHECK_EQUAL(DB::SchemaCache::split("Accounts").first, "");
+    auto select = DB::Select::factory("archive.Accounts");
+    select.columns("id").join(DB::Join(DB::JOIN::INNER, "Users", "Users.id", "Accounts.user_id"));
+    BOOST_CHECK_EQUAL(select.compile().sql(), "SELECT id FROM `archive`.`Accounts` JOIN Users ON Users.id = Accounts.user_id ;");
+    BOOST_CHECK_EQUAL(DB::IndexAdvisor::ddl("archive.Accounts", {"type"}),
+        "CREATE INDEX IF NOT EXISTS `archive`.`idx_Accounts_type` ON `Accounts` (`type`);");
+
+    BOOST_CHECK_EQUAL(DB::Router::replica_uri("data/2024#1.db"), "file:data/2024%231.db?mode=ro&immutable=1");
+    BOOST_CHECK_EQUAL(DB::Router::route("main.db"), "main.db");
+    DB::Router::add_replica("main.db", "replica1.db");
+    DB::Router::add_replica("main.db", "replica2.db");
+    const auto first = DB::Router::route("main.db");
+    BOOST_CHECK(first == "replica1.db" or first == "replica2.db");
+    BOOST_CHECK_NE(DB::Router::route("main.db"), first);
+    DB::Router::remove_replicas("main.db");
+    BOOST_CHECK_EQUAL(DB::Router::route("main.db"), "main.db");
+}
+
+BOOST_AUTO_TEST_CASE(resultColumnName)
+{
+    BOOST_CHECK_EQUAL(DB::Select::column_name("`Accounts`.`id`"), "id");
+    BOOST_CHECK_EQUAL(DB::Select::column_name("Accounts.rowid"), "rowid");
+    BOOST_CHECK_EQUAL(DB::Select::column_name("name"), "name");
+}
+
+BOOST_AUTO_TEST_CASE(copiedBuilderKeepsFragments)
+{
+    auto select = DB::Select::factory("Accounts");
+    const std::string column = "balance";
+    select.columns(DB::StringRef(column).substr(0, 3), "b").where("id", ">", "5").group_by("id");
+    auto copy = select;
+    select.clear().columns("id");
+    BOOST_CHECK_EQUAL(copy.compile().sql(), "SELECT bal AS `b` FROM `Accounts`  WHERE id>? GROUP BY id;");
+    BOOST_CHECK_EQUAL(select.compile().sql(), "SELECT id FROM `Accounts` ;");
+}
+
+BOOST_AUTO_TEST_CASE(clearResetsJoins)
+{
+    auto select = DB::Select::factory("Accounts");
+    select.columns("id").join(DB::Join("Users")).clear();
+    BOOST_CHECK_EQUAL(select.columns("id").compile().sql(), "SELECT id FROM `Accounts` ;");
+}
+
+BOOST_AUTO_TEST_CASE(batchCollectsQueries)
+{
+    DB::Batch batch;
+    for(auto i : boost::irange(0, 20))
+        batch.add(DB::Select::factory("Accounts").columns("id").where("id", "=", i));
+    BOOST_CHECK_EQUAL(batch.size(), 20u);
+    BOOST_CHECK_EQUAL(DB::SessionPool::get("main.db")->stats().used, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(metricsPrometheusExport)
+{
+    DB::QueryMetrics::record("SELECT 1", DB::STAGE::EXECUTE, std::chrono::microseconds(30));
+    DB::QueryMetrics::record_execution("SELECT 1", 1, 1);
+    const auto text = DB::QueryMetrics::prometheus();
+    BOOST_CHECK(text.find("db_queries_total{query=\"SELECT 1\"}") != std::string::npos);
+    BOOST_CHECK(text.find("db_stage_seconds_bucket{query=\"SELECT 1\",stage=\"execute\",le=\"5e-05\"} 1") != std::string::npos);
+    BOOST_CHECK(text.find("le=\"+Inf\"} 1") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(metricsTraceOutlivesReset)
+{
+    DB::QueryTrace trace("SELECT 2");
+    DB::QueryMetrics::reset();
+    trace.mark(DB::STAGE::EXECUTE);
+    trace.finish(1, 1);
+    BOOST_CHECK(DB::QueryMetrics::snapshot().empty());
+    DB::QueryTrace fresh("SELECT 2");
+    fresh.finish(3, 3);
+    const auto shapes = DB::QueryMetrics::snapshot();
+    BOOST_REQUIRE_EQUAL(shapes.size(), 1u);
+    BOOST_CHECK_EQUAL(shapes[0].count, 1u);
+    BOOST_CHECK_EQUAL(shapes[0].rows, 3u);
+}
+
+BOOST_AUTO_TEST_CASE(slowQueryLogFormat)
+{
+    DB::SlowQueryLog::Entry entry;
+    entry.sql = "SELECT * FROM `t` WHERE id = ?;";
+    entry.params.push_back(DB::Param(5));
+    entry.rows = 2;
+    entry.total = std::chrono::microseconds(1500);
+    entry.stages.fill(std::chrono::microseconds(0));
+    entry.stages[static_cast<std::size_t>(DB::STAGE::EXECUTE)] = std::chrono::microseconds(1500);
+    entry.plan = "SCAN TABLE t";
+    BOOST_CHECK_EQUAL(DB::SlowQueryLog::format(entry),
+        "[slow query] 1.500 ms (execute 1.500 ms, rows 2) SELECT * FROM `t` WHERE id = ?; [5] plan: SCAN TABLE t");
+}
+
+BOOST_AUTO_TEST_CASE(resultCacheInvalidation)
+{
+    auto connection = DB::SessionPool::get("main.db")->acquire();
+    const DB::CompiledQuery query(DB::SessionPool::SessionPtr(), DB::normalize("SELECT id FROM `Accounts` WHERE id = 1;"), {"id"});
+    DB::ResultCache::store("main.db", query, {"Accounts", "Users"}, {{{"id", "1"}}}, std::chrono::seconds(60));
+    BOOST_REQUIRE(DB::ResultCache::lookup(*connection, "main.db", query));
+    BOOST_CHECK_EQUAL(DB::ResultCache::lookup(*connection, "main.db", query)->at(0).at("id"), "1");
+    BOOST_CHECK( ! DB::ResultCache::lookup(*connection, "main.db", DB::CompiledQuery(query).bind(0, 2)));
+    DB::invalidate("Users");
+    BOOST_CHECK( ! DB::ResultCache::lookup(*connection, "main.db", query));
+}
+
+BOOST_FIXTURE_TEST_CASE(resultCacheDataVersion, TestDatabase)
+{
+    DB::ResultCache::Config config;
+    config.check_data_version = true;
+    DB::ResultCache::configure(config);
+    auto reader = DB::SessionPool::get(db_name)->acquire();
+    auto other_reader = DB::SessionPool::get(db_name)->acquire();
+    auto writer = DB::SessionPool::get(db_name)->acquire();
+    const DB::CompiledQuery query(DB::SessionPool::SessionPtr(), DB::normalize("SELECT id FROM `Users` WHERE id = 1;"), {"id"});
+    const auto store = [&]() { DB::ResultCache::store(db_name, query, {"Users"}, {{{"id", "1"}}}, std::chrono::seconds(60)); };
+
+    // Entry stored before the first check through the connection can't be trusted
+    store();
+    BOOST_CHECK( ! DB::ResultCache::lookup(*reader, db_name, query));
+    BOOST_CHECK( ! DB::ResultCache::lookup(*other_reader, db_name, query));
+    store();
+    // Pooled sessions take turns, each compares versions seen by itself
+    BOOST_CHECK(DB::ResultCache::lookup(*reader, db_name, query));
+    BOOST_CHECK(DB::ResultCache::lookup(*other_reader, db_name, query));
+    BOOST_CHECK(DB::ResultCache::lookup(*reader, db_name, query));
+    writer->session << "INSERT INTO Users VALUES (3, 'cid');", Poco::Data::now;
+    BOOST_CHECK( ! DB::ResultCache::lookup(*reader, db_name, query));
+    store();
+    BOOST_CHECK( ! DB::ResultCache::lookup(*other_reader, db_name, query));
+    store();
+    BOOST_CHECK(DB::ResultCache::lookup(*reader, db_name, query));
+    BOOST_CHECK(DB::ResultCache::lookup(*other_reader, db_name, query));
+    BOOST_CHECK( ! DB::ResultCache::lookup(*writer, db_name, query));
+    DB::ResultCache::configure(DB::ResultCache::Config());
+}
+
+BOOST_AUTO_TEST_CASE(batchFilters)
+{
+    const std::vector<FilterCols> cols = {
+        FilterCols("czas", "", time_, batch_filter(filters::time())),
+        FilterCols("rozmiar", "", filesize_, batch_filter(filters::filesize())),
+        FilterCols("urodziny", "", birthday_),
+    };
+    const DB::Data data = {
+        {{"czas", "3725"}, {"rozmiar", "2048"}, {"urodziny", "19900215"}},
+        {{"czas", ""}, {"rozmiar", "10"}, {"urodziny", "1990"}},
+    };
+    std::vector<FilterArena> out;
+    apply_filters(cols, data, out);
+    BOOST_CHECK_EQUAL(out[0][0], "1h 2min 5s");
+    BOOST_CHECK_EQUAL(out[0][1], "0");
+    BOOST_CHECK_EQUAL(out[1][0], "2.00KB");
+    BOOST_CHECK_EQUAL(out[1][1], "10.00B");
+    BOOST_CHECK_EQUAL(out[2][0], "15-02-1990");
+    BOOST_CHECK_EQUAL(out[2][1], "nieznana");
+    BOOST_CHECK_EQUAL(timezone_("90000"), "GMT +1");
+    // Value too long for the buffer is cut instead of read past its end
+    std::string huge;
+    filters::filesize()("1e300", huge);
+    BOOST_CHECK_LT(huge.size(), 40u);
+}
+
+BOOST_AUTO_TEST_CASE(timestampFormat)
+{
+    BOOST_CHECK_EQUAL(timestamp_("1700000000"), "22:13:20 14/11/2023");
+    BOOST_CHECK_EQUAL(timestamp_("0"), "nieznany");
+    BOOST_CHECK_EQUAL(spec_timestamp_("1"), "00:01:00 01/1/1970");
+    const filters::TimestampFormat format("%w %e %b %Y %h%a, %%d");
+    char buf[64];
+    BOOST_CHECK_LE(format.max_size(), sizeof(buf));
+    BOOST_CHECK_EQUAL(std::string(buf, format.format(-86400, buf)), "Wed 31 Dec 1969 12am, %d");
+}
+
+BOOST_FIXTURE_TEST_CASE(staticQuerySql, TestDatabase)
+{
+    typedef DB::StaticSelect<AccountsTable, DB::Cols<AccountId, AccountName>,
+        DB::Where<DB::Gt<AccountId>, DB::Like<AccountName>>, DB::StaticJoin<UsersTable, UserId, AccountUser>> Query;
+    BOOST_CHECK_EQUAL(Query::sql(), "SELECT `Accounts`.`id`, `Accounts`.`name` FROM `Accounts` JOIN `Users` ON `Users`.`id` = "
+        "`Accounts`.`user_id` WHERE `Accounts`.`id` > ? AND `Accounts`.`name` LIKE ?;");
+    BOOST_CHECK_EQUAL(std::tuple_size<Query::Arguments>::value, 2u);
+    BOOST_CHECK((std::is_same<Query::Row, std::tuple<Poco::Int64, std::string>>::value));
+    auto rows = Query::get(db_name, 1, "%a");
+    std::sort(rows.begin(), rows.end());
+    BOOST_REQUIRE_EQUAL(rows.size(), 2u);
+    BOOST_CHECK_EQUAL(std::get<0>(rows[0]), 2);
+    BOOST_CHECK_EQUAL(std::get<1>(rows[0]), "beta");
+    BOOST_CHECK_EQUAL(std::get<1>(rows[1]), "gamma");
+    BOOST_CHECK(Query::get(db_name, 5, "a%").empty());
+    BOOST_CHECK_EQUAL((DB::StaticSelect<UsersTable, DB::Cols<UserId>>::sql()), std::string("SELECT `Users`.`id` FROM `Users`;"));
+}
+
+BOOST_FIXTURE_TEST_CASE(insertMultiRowSql, TestDatabase)
+{
+    auto insert = DB::Insert::factory("Accounts", db_name);
+    insert.columns({"id", "name"}).values(1, std::string("a")).values(DB::Params{DB::Param(6), DB::Param(std::string("b"))});
+    BOOST_CHECK_EQUAL(insert.size(), 2u);
+    BOOST_CHECK_EQUAL(insert.sql(2), "INSERT INTO `Accounts` (`id`, `name`) VALUES (?, ?), (?, ?);");
+    insert.on_conflict(DB::CONFLICT::REPLACE);
+    BOOST_CHECK_EQUAL(insert.sql(1), "INSERT OR REPLACE INTO `Accounts` (`id`, `name`) VALUES (?, ?);");
+    insert.on_conflict(DB::CONFLICT::ABORT).upsert({"id"});
+    BOOST_CHECK_EQUAL(insert.sql(1), "INSERT INTO `Accounts` (`id`, `name`) VALUES (?, ?) ON CONFLICT (`id`) DO UPDATE SET `name` = excluded.`name`;");
+    BOOST_CHECK_EQUAL(insert.commit_every(1).execute(), 2u);
+    BOOST_CHECK_EQUAL(insert.size(), 0u);
+    // Existing row is updated by the upsert, the new one is added
+    const auto rows = DB::Select::factory("Accounts", db_name).columns("id").columns("name").columns("balance").order_by("id").get();
+    BOOST_REQUIRE_EQUAL(rows.size(), 6u);
+    BOOST_CHECK_EQUAL(rows[0].at("name"), "a");
+    BOOST_CHECK_EQUAL(rows[0].at("balance"), "10.5");
+    BOOST_CHECK_EQUAL(rows[5].at("id"), "6");
+    BOOST_CHECK_EQUAL(rows[5].at("name"), "b");
+}
+
+BOOST_FIXTURE_TEST_CASE(exportEscaping, TestDatabase)
+{
+    std::string out;
+    exporters::write_csv(out, "plain");
+    exporters::write_csv(out.append(1, ','), "with \"quote\", comma");
+    BOOST_CHECK_EQUAL(out, "plain,\"with \"\"quote\"\", comma\"");
+    out.clear();
+    exporters::write_json(out, "a\"b\\c\nd\x01");
+    BOOST_CHECK_EQUAL(out, "\"a\\\"b\\\\c\\nd\\u0001\"");
+
+    // Chunks of 2 rows: types are fixed by the first one, text of the last row doesn't fit INTEGER column "type"
+    auto select = DB::Select::factory("Accounts", db_name);
+    select.columns("id").columns("name").columns("balance").columns("type").order_by("id");
+    std::ostringstream json;
+    {
+        ExportSink sink(json, 64);
+        BOOST_CHECK_EQUAL(export_rows(select, sink, EXPORT::JSON_LINES, {}, true, 2), 5u);
+    }
+    const auto lines = json.str();
+    BOOST_CHECK(lines.find("{\"id\":4,\"name\":\"\",\"balance\":0,\"type\":2}\n") != std::string::npos);
+    BOOST_CHECK(lines.find("{\"id\":5,\"name\":null,\"balance\":7,\"type\":\"n/a\"}\n") != std::string::npos);
+
+    // Columnar format can't write the text into INTEGER column, unless the column is cast to TEXT
+    std::ostringstream failed;
+    {
+        ExportSink sink(failed, 64);
+        BOOST_CHECK_THROW(export_rows(select, sink, EXPORT::COLUMNAR, {}, true, 2), Poco::Data::DataException);
+    }
+    select.clear().columns("id").columns("name").columns("balance").columns("CAST(type AS TEXT)", "type").order_by("id");
+    std::ostringstream stream;
+    {
+        ExportSink sink(stream, 64);
+        BOOST_CHECK_EQUAL(export_rows(select, sink, EXPORT::COLUMNAR, {}, true, 2), 5u);
+        sink.flush();
+        BOOST_CHECK_EQUAL(sink.written(), 242u);
+    }
+    const auto bytes = stream.str();
+    BOOST_REQUIRE_EQUAL(bytes.size(), 242u);
+    const auto read = [&bytes](const std::size_t pos, void *val, const std::size_t size) { std::memcpy(val, bytes.data() + pos, size); };
+    std::uint32_t u32 = 0;
+    BOOST_CHECK_EQUAL(bytes.substr(0, 8), "DBCOLS01");
+    read(8, &u32, 4);
+    BOOST_CHECK_EQUAL(u32, 4u);
+    // Header: types of id, name, balance and type columns
+    BOOST_CHECK_EQUAL(static_cast<int>(bytes[12]), 0);
+    BOOST_CHECK_EQUAL(static_cast<int>(bytes[19]), 2);
+    BOOST_CHECK_EQUAL(static_cast<int>(bytes[28]), 1);
+    BOOST_CHECK_EQUAL(static_cast<int>(bytes[40]), 2);
+    BOOST_CHECK_EQUAL(bytes.substr(45, 4), "type");
+    // The last batch (row of id 5) starts after header (49 B) and two batches (75 B and 71 B)
+    read(195, &u32, 4);
+    BOOST_CHECK_EQUAL(u32, 1u);
+    Poco::Int64 id = 0;
+    read(200, &id, 8);
+    BOOST_CHECK_EQUAL(id, 5);
+    BOOST_CHECK_EQUAL(static_cast<int>(bytes[208]), 1);
+    double balance = 0.0;
+    read(218, &balance, 8);
+    BOOST_CHECK_EQUAL(balance, 7.0);
+    BOOST_CHECK_EQUAL(static_cast<int>(bytes[226]), 0);
+    read(231, &u32, 4);
+    BOOST_CHECK_EQUAL(u32, 3u);
+    BOOST_CHECK_EQUAL(bytes.substr(235, 3), "n/a");
+    read(238, &u32, 4);
+    BOOST_CHECK_EQUAL(u32, 0u);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 
@@ -0,0 +1,225 @@
+#include "DBReflectionHelper.h"
+#include "db_filters.h"
+#include "db_export.h"
+#include "Insert.h"
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+/**
+ * Benchmark of the query builder: building, executing and fetching queries, formatting and exporting results and bulk inserts
+ * Synthetic database is generated on start, results are printed to stdout as JSON
+ *
+ * Usage: benchmark [--rows N] [--width N] [--iterations N] [--db FILE]
+ */
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    struct Options {
+        unsigned long rows = 100000;
+        unsigned width = 8; /// Text columns added to the typed ones
+        unsigned long iterations = 10;
+        std::string db_name = "benchmark.db";
+    };
+
+    /// Result of one measured operation
+    struct Result {
+        std::string name;
+        unsigned long long operations;
+        double total_ms;
+    };
+
+    /**
+     * Creating table `bench` with columns used by the filters and width additional text columns
+     *
+     * @param Options options size of the table
+     */
+    void generate(const Options &options)
+    {
+        using namespace Poco::Data;
+
+        auto connection = DB::SessionPool::get(options.db_name)->acquire();
+        std::string create = "CREATE TABLE bench (id INTEGER PRIMARY KEY, created INTEGER, duration INTEGER, "
+            "size INTEGER, birthday TEXT, timezone INTEGER";
+        std::string values = "x, 1400000000 + x * 37, x % 100000, abs(random() % 10000000000), "
+            "printf('19%02d%02d%02d', x % 100, x % 12 + 1, x % 28 + 1), 43200 + (x % 25) * 3600";
+        for(unsigned i = 0; i < options.width; ++i)
+        {
+            create += ", text" + std::to_string(i) + " TEXT";
+            values += ", 'value ' || (x * " + std::to_string(i + 1) + ")";
+        }
+        connection->session << "DROP TABLE IF EXISTS bench;", now;
+        connection->session << create + ");", now;
+        connection->session << "WITH RECURSIVE seq(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM seq LIMIT "
+            + std::to_string(options.rows) + ") INSERT INTO bench SELECT " + values + " FROM seq;", now;
+        DB::SchemaCache::invalidate(options.db_name);
+    }
+
+    /**
+     * Measuring operation repeated given number of times
+     *
+     * @param  std::string name name of the result
+     * @param  unsigned long long operations number of operations done by all repetitions (i.e. cells)
+     * @param  unsigned long repeat number of calls
+     * @param  Fn fn measured operation
+     * @return Result time of all calls
+     */
+    template <typename Fn>
+    Result measure(const std::string &name, const unsigned long long operations, const unsigned long repeat, Fn fn)
+    {
+        const auto start = Clock::now();
+        for(unsigned long i = 0; i < repeat; ++i)
+            fn();
+        const std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+
+        return Result{name, operations, elapsed.count()};
+    }
+
+    std::string json_escape(const std::string &text)
+    {
+        std::string res;
+        for(const char c : text)
+        {
+            if(c == '"' or c == '\\')
+                res += '\\';
+            if(static_cast<unsigned char>(c) < 0x20)
+                res += ' ';
+            else
+                res += c;
+        }
+        return res;
+    }
+
+    Options parse_options(int argc, char **argv)
+    {
+        Options options;
+        for(int i = 1; i + 1 < argc; i += 2)
+        {
+            if(std::strcmp(argv[i], "--rows") == 0)
+                options.rows = std::strtoul(argv[i + 1], nullptr, 10);
+            else if(std::strcmp(argv[i], "--width") == 0)
+                options.width = static_cast<unsigned>(std::strtoul(argv[i + 1], nullptr, 10));
+            else if(std::strcmp(argv[i], "--iterations") == 0)
+                options.iterations = std::strtoul(argv[i + 1], nullptr, 10);
+            else if(std::strcmp(argv[i], "--db") == 0)
+                options.db_name = argv[i + 1];
+        }
+        options.rows = std::max(1ul, options.rows);
+        options.iterations = std::max(1ul, options.iterations);
+
+        return options;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const auto options = parse_options(argc, argv);
+    std::vector<Result> results;
+    generate(options);
+    auto select = DB::Select::factory("bench", options.db_name);
+    DB::QueryMetrics::reset();
+
+    // Building queries, without touching the database
+    const unsigned long builds = 10000 * options.iterations;
+    select.columns("id").columns("created").columns("size", "rozmiar")
+        .join(DB::Join(DB::JOIN::LEFT_OUTER, "bench", "b2", "b2.id", "bench.id"))
+        .where("id", ">", 10).and_where("birthday", "LIKE", DB::Param(std::string("19%"))).order_by("created").limit(100);
+    results.push_back(measure("build", builds, builds, [&]() { select.compile(); }));
+
+    // Whole result, end to end
+    select.clear();
+    DB::Data data;
+    results.push_back(measure("get", options.rows * options.iterations, options.iterations, [&]() { data = select.get(); }));
+    DB::ColumnarData columnar;
+    results.push_back(measure("get_columnar", options.rows * options.iterations, options.iterations,
+        [&]() { columnar = select.get_columnar(); }));
+    std::size_t streamed = 0;
+    results.push_back(measure("cursor", options.rows * options.iterations, options.iterations, [&]() {
+        select.stream([&](const DB::Row&) { ++streamed; return true; }, 10000);
+    }));
+
+    // Stages of get(), measured by QueryMetrics
+    static const char *stage_names[] = {"build", "prepare", "execute", "fetch", "convert"};
+    for(const auto &shape : DB::QueryMetrics::snapshot())
+    {
+        if(shape.sql.find("FROM `bench`  WHERE") != std::string::npos)
+            continue;
+        for(std::size_t stage = 0; stage < DB::QueryMetrics::STAGES; ++stage)
+            if(shape.stages[stage].count != 0)
+                results.push_back(Result{std::string("stage.") + stage_names[stage] + " " + shape.sql,
+                    shape.rows, shape.stages[stage].sum_us / 1000.0});
+    }
+
+    // Filters, cell by cell and whole columns at once
+    const std::vector<FilterCols> filter_cols = {
+        FilterCols("created", "", timestamp_, batch_filter(filters::timestamp())),
+        FilterCols("created", "", spec_timestamp_, batch_filter(filters::timestamp(60))),
+        FilterCols("duration", "", time_, batch_filter(filters::time())),
+        FilterCols("size", "", filesize_, batch_filter(filters::filesize())),
+        FilterCols("birthday", "", birthday_, batch_filter(filters::birthday())),
+        FilterCols("timezone", "", timezone_, batch_filter(filters::timezone())),
+    };
+    static const char *filter_names[] = {"timestamp_", "spec_timestamp_", "time_", "filesize_", "birthday_", "timezone_"};
+    ColumnView view;
+    FilterArena arena;
+    std::size_t checksum = 0;
+    for(std::size_t i = 0; i < filter_cols.size(); ++i)
+    {
+        const auto &filter = filter_cols[i];
+        column_view(data, filter.column(), view);
+        results.push_back(measure(std::string("filter.") + filter_names[i], view.size() * options.iterations, options.iterations, [&]() {
+            for(const auto &row : data)
+                checksum += filter.filter(row.at(filter.column())).size();
+        }));
+        results.push_back(measure(std::string("filter_batch.") + filter_names[i], view.size() * options.iterations, options.iterations,
+            [&]() { filter.apply(view, arena); checksum += arena.size(); }));
+    }
+
+    // Export straight from the cursor, output is discarded
+    std::ofstream devnull("/dev/null", std::ios::binary);
+    static const char *export_names[] = {"export.csv", "export.json_lines", "export.columnar"};
+    const EXPORT formats[] = {EXPORT::CSV, EXPORT::JSON_LINES, EXPORT::COLUMNAR};
+    for(std::size_t i = 0; i < 3; ++i)
+        results.push_back(measure(export_names[i], options.rows * options.iterations, options.iterations, [&]() {
+            ExportSink sink(devnull);
+            checksum += export_rows(select, sink, formats[i], filter_cols);
+        }));
+
+    // Bulk insert, the same rows are replaced in every iteration
+    {
+        auto connection = DB::SessionPool::get(options.db_name)->acquire();
+        connection->session << "DROP TABLE IF EXISTS bench_insert;", Poco::Data::now;
+        connection->session << "CREATE TABLE bench_insert (id INTEGER PRIMARY KEY, created INTEGER, name TEXT);", Poco::Data::now;
+    }
+    auto insert = DB::Insert::factory("bench_insert", options.db_name);
+    insert.columns({"id", "created", "name"}).on_conflict(DB::CONFLICT::REPLACE).synchronous(DB::SYNCHRONOUS::OFF);
+    results.push_back(measure("insert", options.rows * options.iterations, options.iterations, [&]() {
+        for(unsigned long id = 0; id < options.rows; ++id)
+            insert.values(id, 1400000000 + id, std::string("name"));
+        checksum += insert.execute();
+    }));
+
+    std::ostringstream out;
+    out << "{\"rows\": " << options.rows << ", \"width\": " << options.width
+        << ", \"iterations\": " << options.iterations << ", \"checksum\": " << checksum + streamed << ", \"results\": [";
+    for(std::size_t i = 0; i < results.size(); ++i)
+    {
+        const auto &res = results[i];
+        char timings[128];
+        std::snprintf(timings, sizeof(timings), "\"total_ms\": %.3f, \"ns_per_op\": %.1f",
+            res.total_ms, res.operations != 0 ? res.total_ms * 1e6 / res.operations : 0.0);
+        out << (i != 0 ? ",\n    " : "\n    ") << "{\"name\": \"" << json_escape(res.name) << "\", \"operations\": "
+            << res.operations << ", " << timings << '}';
+    }
+    out << "\n]}\n";
+    std::cout << out.str();
+    DB::shutdown();
+
+    return 0;
+}
@@ -0,0 +1,97 @@
+#ifndef ASYNCEXECUTOR_H
+#define ASYNCEXECUTOR_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <exception>
+#include <utility>
+#include "SessionPool.h"
+#include "CompiledQuery.h"
+
+namespace DB
+{
+    /**
+     * Fixed pool of worker threads executing queries in the background
+     * Workers borrow sessions from SessionPool for every query, so limits of the pool apply to them too.
+     * Submission queue is bounded, submit() blocks when it is full.
+     */
+    class AsyncExecutor
+    {
+        public:
+            typedef CompiledQuery::Data Data;
+            /// Called by the worker with the result or with the exception thrown by the query, it must not block on submit()
+            typedef std::function<void(const Data&, std::exception_ptr)> Callback;
+
+            AsyncExecutor(const std::size_t workers, const std::size_t queue_size);
+            AsyncExecutor(const AsyncExecutor&) = delete;
+            AsyncExecutor& operator=(const AsyncExecutor&) = delete;
+            ~AsyncExecutor();
+
+            static AsyncExecutor& instance();
+
+            std::future<Data> submit(const std::string &db_name, const CompiledQuery &query);
+            void submit(const std::string &db_name, const CompiledQuery &query, const Callback &callback);
+            template <typename Work>
+            auto execute(const std::string &db_name, Work work) -> std::future<decltype(work(std::declval<Connection&>()))>;
+            std::size_t pending() const;
+        private:
+            /// Session for the database, borrowed from its pool on first use
+            /// Task gives it back before publishing the result, so the session is free when the caller gets it
+            struct SessionProvider {
+                std::function<Connection&()> acquire;
+                std::function<void()> release;
+            };
+            /// Work executed on the borrowed session
+            struct Task {
+                std::string db_name;
+                std::function<void(const SessionProvider&)> run;
+            };
+
+            void _push(Task &&task);
+            void _work();
+
+            std::vector<std::thread> _workers;
+            std::deque<Task> _queue;
+            const std::size_t _queue_size;
+            bool _stopping = false;
+            mutable std::mutex _mutex;
+            std::condition_variable _not_empty;
+            std::condition_variable _not_full;
+    };
+
+    /**
+     * Queue any work using a session of the database (i.e. query read in non-standard way)
+     *
+     * @param  std::string db_name name of database
+     * @param  Work work callable taking Connection&, it must not keep the session after returning
+     * @return std::future result of the work or exception thrown by it
+     */
+    template <typename Work>
+    auto AsyncExecutor::execute(const std::string &db_name, Work work) -> std::future<decltype(work(std::declval<Connection&>()))>
+    {
+        typedef decltype(work(std::declval<Connection&>())) Result;
+        auto result = std::make_shared<std::promise<Result>>();
+        auto future = result->get_future();
+        _push(Task{db_name, [work, result](const SessionProvider &session) {
+            try {
+                auto value = work(session.acquire());
+                session.release();
+                result->set_value(std::move(value));
+            }
+            catch(...) {
+                session.release();
+                result->set_exception(std::current_exception());
+            }
+        }});
+
+        return future;
+    }
+}
+#endif // ASYNCEXECUTOR_H
@@ -0,0 +1,33 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <string>
+#include <vector>
+#include "CompiledQuery.h"
+
+namespace DB
+{
+    class Select;
+
+    /**
+     * Many queries executed together, on one session and inside one read transaction
+     * Queries of the same shape share the prepared statement
+     */
+    class Batch
+    {
+        public:
+            typedef CompiledQuery::Data Data;
+
+            explicit Batch(const std::string &db_name = std::string("main.db")) : _db_name(db_name) {}
+
+            Batch& add(Select &select, const std::string &table_name = std::string());
+            Batch& add(const CompiledQuery &query);
+            std::vector<Data> get();
+            std::size_t size() const { return _queries.size(); }
+            Batch& clear();
+        private:
+            std::string _db_name;
+            std::vector<CompiledQuery> _queries; /// Detached, so they don't hold sessions
+    };
+}
+#endif // BATCH_H
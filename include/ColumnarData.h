@@ -0,0 +1,79 @@
+#ifndef COLUMNARDATA_H
+#define COLUMNARDATA_H
+
+#include <string>
+#include <vector>
+#include <boost/utility/string_ref.hpp>
+#include "Poco/Types.h"
+
+namespace DB
+{
+    /**
+     * Values of single result column stored in one contiguous, typed container
+     * Column falls back to TEXT storage when a value doesn't fit its type (SQLite types values, not columns)
+     */
+    class ColumnVector
+    {
+        friend class ColumnarData;
+        public:
+            /// Storage of values
+            enum class TYPE { INTEGER, REAL, TEXT };
+
+            explicit ColumnVector(const TYPE type = TYPE::TEXT) : _type(type) { _offsets.push_back(0); }
+
+            TYPE type() const { return _type; }
+            std::size_t size() const { return _nulls.size(); }
+            bool is_null(const std::size_t row) const { return _nulls[row]; }
+            Poco::Int64 get_int(const std::size_t row) const;
+            double get_real(const std::size_t row) const;
+            boost::string_ref get_text(const std::size_t row) const;
+            std::string to_string(const std::size_t row) const;
+            std::size_t memory_usage() const;
+        private:
+            void _reserve(const std::size_t rows);
+            void _push_int(const Poco::Int64 val);
+            void _push_real(const double val);
+            void _push_text(const char *val, const std::size_t len);
+            void _push_null();
+            void _to_text();
+
+            TYPE _type;
+            std::vector<Poco::Int64> _ints; /// INTEGER column values
+            std::vector<double> _reals; /// REAL column values
+            std::string _arena; /// TEXT column values, one after another
+            std::vector<std::size_t> _offsets; /// Start of each text in the arena (+ end of the last one)
+            std::vector<bool> _nulls; /// Null bitmap
+    };
+
+    /**
+     * Result of the query stored by columns
+     * Column names are kept once and each column is a single typed vector, instead of map per row
+     */
+    class ColumnarData
+    {
+        public:
+            ColumnarData() {}
+            ColumnarData(const std::vector<std::string> &names, const std::vector<ColumnVector::TYPE> &types);
+
+            std::size_t rows() const { return _columns.empty() ? 0 : _columns.front().size(); }
+            std::size_t cols() const { return _columns.size(); }
+            const std::vector<std::string>& names() const { return _names; }
+            std::size_t index(const std::string &name) const;
+            const ColumnVector& column(const std::size_t col) const { return _columns[col]; }
+            const ColumnVector& column(const std::string &name) const { return _columns[index(name)]; }
+            std::string get(const std::size_t row, const std::size_t col) const { return _columns[col].to_string(row); }
+            std::string get(const std::size_t row, const std::string &name) const { return column(name).to_string(row); }
+            std::size_t memory_usage() const;
+
+            // Filling data, column by column for each row
+            void reserve(const std::size_t rows);
+            void push_int(const std::size_t col, const Poco::Int64 val) { _columns[col]._push_int(val); }
+            void push_real(const std::size_t col, const double val) { _columns[col]._push_real(val); }
+            void push_text(const std::size_t col, const std::string &val) { _columns[col]._push_text(val.data(), val.size()); }
+            void push_null(const std::size_t col) { _columns[col]._push_null(); }
+        private:
+            std::vector<std::string> _names;
+            std::vector<ColumnVector> _columns;
+    };
+}
+#endif // COLUMNARDATA_H
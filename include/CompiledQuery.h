@@ -0,0 +1,47 @@
+#ifndef COMPILEDQUERY_H
+#define COMPILEDQUERY_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include "SessionPool.h"
+#include "StatementCache.h"
+#include "Poco/DynamicAny.h"
+
+namespace DB
+{
+    /**
+     * Query rendered once by Select::compile(), ready to be executed many times
+     * Values of placeholders can be changed between executions without rendering the query again
+     */
+    class CompiledQuery
+    {
+        public:
+            typedef std::vector<std::string> ColsInfo;
+            typedef std::map<std::string, std::string> Row;
+            typedef std::vector<Row> Data;
+
+            CompiledQuery(const SessionPool::SessionPtr &connection, const QueryShape &shape, const ColsInfo &cols)
+                : _connection(connection), _shape(shape), _cols(cols) {}
+
+            const std::string& sql() const { return _shape.text; }
+            const Params& params() const { return _shape.params; }
+            const ColsInfo& cols() const { return _cols; }
+            CompiledQuery& bind(const std::size_t pos, const Param &value);
+            CompiledQuery detached() const;
+
+            Data get() const;
+            Data get(Connection &connection) const;
+            Data get(Connection &connection, const std::vector<std::size_t> &typed_cols, Params &typed) const;
+        private:
+            friend class Batch;
+            Data _fetch(Connection &connection, const std::vector<std::size_t> &typed_cols = std::vector<std::size_t>(),
+                Params *typed = nullptr) const;
+            static Param _typed(const Poco::DynamicAny &field, const bool blob);
+
+            SessionPool::SessionPtr _connection; /// Session of the Select which compiled the query (empty if detached)
+            QueryShape _shape;
+            ColsInfo _cols;
+    };
+}
+#endif // COMPILEDQUERY_H
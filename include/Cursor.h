@@ -0,0 +1,82 @@
+#ifndef CURSOR_H
+#define CURSOR_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <iterator>
+#include "Poco/Data/Common.h"
+#include "Poco/Data/RecordSet.h"
+#include "SessionPool.h"
+#include "StatementCache.h"
+
+namespace DB
+{
+    /**
+     * Lazy reader of the query result
+     * Rows are fetched from the statement in chunks, so only one chunk is kept in memory
+     */
+    class Cursor
+    {
+        public:
+            typedef std::vector<std::string> ColsInfo;
+            typedef std::map<std::string, std::string> Row;
+
+            Cursor(const SessionPool::SessionPtr &connection, const QueryShape &shape, const ColsInfo &cols, const std::size_t chunk_size);
+            Cursor(const Cursor&) = delete;
+            Cursor& operator=(const Cursor&) = delete;
+
+            bool next();
+            const Row& row() const { return _row; }
+            const ColsInfo& cols() const { return _cols; }
+            /// Current chunk and position in it, for reading values without building Row
+            const Poco::Data::RecordSet& chunk() const { return *_chunk; }
+            std::size_t chunk_row() const { return _chunk_row; }
+            bool next_raw();
+            bool next_chunk();
+        private:
+            bool _fetch();
+
+            SessionPool::SessionPtr _connection; /// Session is borrowed as long as cursor lives
+            Params _params; /// Values bound to the statement
+            Poco::Data::Statement _statement;
+            std::unique_ptr<Poco::Data::RecordSet> _chunk;
+            std::size_t _chunk_row = 0;
+            bool _started = false;
+            ColsInfo _cols;
+            Row _row; /// Reused for every row
+    };
+
+    /**
+     * Range of rows read through the cursor, usable in range-based for
+     */
+    class RowRange
+    {
+        public:
+            class iterator : public std::iterator<std::input_iterator_tag, const Cursor::Row>
+            {
+                public:
+                    explicit iterator(Cursor *cursor = nullptr) : _cursor(cursor) {}
+                    const Cursor::Row& operator*() const { return _cursor->row(); }
+                    const Cursor::Row* operator->() const { return &_cursor->row(); }
+                    iterator& operator++()
+                    {
+                        if( ! _cursor->next())
+                            _cursor = nullptr;
+                        return (*this);
+                    }
+                    bool operator==(const iterator &other) const { return _cursor == other._cursor; }
+                    bool operator!=(const iterator &other) const { return _cursor != other._cursor; }
+                private:
+                    Cursor *_cursor;
+            };
+
+            explicit RowRange(const std::shared_ptr<Cursor> &cursor) : _cursor(cursor) {}
+            iterator begin() { return _cursor->next() ? iterator(_cursor.get()) : iterator(); }
+            iterator end() { return iterator(); }
+        private:
+            std::shared_ptr<Cursor> _cursor;
+    };
+}
+#endif // CURSOR_H
@@ -6,16 +6,27 @@
 #include <utility>
 #include <vector>
 #include <tuple>
-#include <queue>
 #include <map>
 #include <cassert>
 #include <memory>
+#include <functional>
+#include <atomic>
+#include <boost/utility/string_ref.hpp>
 #include "Poco/Data/Common.h"
 #include "Poco/Data/SQLite/Connector.h"
 #include "Poco/Data/RecordSet.h"
-#ifdef _DEBUG
-#include <iostream>
-#endif
+#include "SessionPool.h"
+#include "SchemaCache.h"
+#include "Param.h"
+#include "ColumnarData.h"
+#include "Cursor.h"
+#include "CompiledQuery.h"
+#include "AsyncExecutor.h"
+#include "Batch.h"
+#include "QueryMetrics.h"
+#include "SlowQueryLog.h"
+#include "ResultCache.h"
+#include "RowMapping.h"
 
 namespace DB
 {
@@ -23,6 +34,8 @@ namespace DB
 
     /// String type used for storing database records
     typedef std::string StringType;
+    /// Non-owning string passed to the builder, copied into its arena
+    typedef boost::string_ref StringRef;
     /// Columns info (names/types)
     typedef std::vector<StringType> ColsInfo;
     /// Single table row
@@ -32,7 +45,7 @@ namespace DB
     /// Name of column (or expression) and, optionally alias for it
     typedef std::pair<StringType, StringType> Column;
     /// Names of columns or expressions used in statement
-    typedef std::queue<Column> Columns;
+    typedef std::vector<Column> Columns;
 
     /// Types of where clauses
     enum class WHERE { OR, AND, };
@@ -42,105 +55,258 @@ namespace DB
     enum class JOIN { CROSS, INNER, LEFT_OUTER };
 
     /// Wrapper around join instead of std::tuple for easier use
+    /// Clause is rendered once, when join is created
     class Join {
         public:
+            Join(const JOIN &type, const StringRef table, const StringRef alias, const StringRef col1, const StringRef col2);
             /// Constructors without column aliases
-            Join(const JOIN &type, const StringType table, const StringType alias, const StringType col1, StringType col2) :
-                _table(table), _col1(col1), _col2(col2), _type(type), _alias(alias)
-                { assert(table != StringType()); }
-            Join(const JOIN &type, const StringType table, const StringType col1, const StringType col2)
-                : Join(type, table, StringType(), col1, col2) {}
-            Join(const StringType table, const StringType alias)
-                : Join(JOIN::CROSS, table, alias, StringType(), StringType()) {}
-            Join(const StringType table)
-                : Join(JOIN::CROSS, table, StringType(), StringType()) {}
-            StringType get_string() const;
+            Join(const JOIN &type, const StringRef table, const StringRef col1, const StringRef col2)
+                : Join(type, table, StringRef(), col1, col2) {}
+            Join(const StringRef table, const StringRef alias)
+                : Join(JOIN::CROSS, table, alias, StringRef(), StringRef()) {}
+            Join(const StringRef table)
+                : Join(JOIN::CROSS, table, StringRef(), StringRef(), StringRef()) {}
+            StringType get_string() const { return _clause; }
+            StringRef clause() const { return _clause; }
+            StringRef table() const { return StringRef(_clause).substr(_table_begin, _table_size); }
         private:
-            StringType _table;
-            StringType _alias;
-            StringType _col1;
-            StringType _col2;
-            JOIN _type = JOIN::CROSS;
+            StringType _clause;
+            std::size_t _table_begin = 0;
+            std::size_t _table_size = 0;
     };
 
     /**
      * Helper for simplified database reflection
-     * In this case, we don't need Create/Update/Delete because we want to leave base untouched
+     * Only reading here, rows are written in bulk by Insert (see Insert.h)
      */
     class Select
     {
+        friend class IndexAdvisor;
         public:
             static Select factory(const StringType &table_name = StringType(), const StringType &db_name = StringType("main.db"));
+            const StringType& db_name() const { return _db_name; }
+            Select& database(const StringType &db_name);
             ColsInfo get_cols(StringType table_name = StringType());
             Data get(StringType table_name = StringType());
+            CompiledQuery compile(StringType table_name = StringType());
+            std::future<Data> async_get(StringType table_name = StringType());
+            std::future<Data> async_get(AsyncExecutor &executor, StringType table_name = StringType());
+            ColumnarData get_columnar(StringType table_name = StringType());
+            // Reading the table in key ranges, each range on its own worker and session
+            Data parallel_get(const std::size_t shards, const StringType key = StringType("rowid"), StringType table_name = StringType());
+            Data parallel_get(AsyncExecutor &executor, const std::size_t shards, const StringType key = StringType("rowid"), StringType table_name = StringType());
+            // Reading the same query from several database files (i.e. monthly shards), each file on its own worker
+            Data get_from(const std::vector<StringType> &db_names, StringType table_name = StringType());
+            Data get_from(AsyncExecutor &executor, const std::vector<StringType> &db_names, StringType table_name = StringType());
+            template <typename T>
+            std::vector<T> get_as(StringType table_name = StringType());
+            // Reading rows lazily, in chunks
+            std::shared_ptr<Cursor> cursor(const std::size_t chunk_size = 1000, StringType table_name = StringType());
+            RowRange rows(const std::size_t chunk_size = 1000, StringType table_name = StringType());
+            std::size_t stream(const std::function<bool(const Row&)> &callback, const std::size_t chunk_size = 1000, StringType table_name = StringType());
             Select& distinct(const bool distinct);
+            // Keeping results of get() in ResultCache
+            Select& cache(const std::chrono::milliseconds ttl = std::chrono::seconds(60));
             // Where clauses
-            Select& where(const WHERE type, const StringType lvalue, const StringType op = StringType(), const StringType rvalue = StringType());
-            Select& where(const StringType lvalue, const StringType op = StringType(), const StringType rvalue = StringType());
-            Select& or_where(const StringType lvalue, const StringType op = StringType(), const StringType rvalue = StringType());
-            Select& and_where(const StringType lvalue, const StringType op = StringType(), const StringType rvalue = StringType());
-            Select& group_by(const StringType column);
-            Select& order_by(const StringType column, ORDER direction = ORDER::ASC);
-            Select& limit(const StringType limit, const StringType offset = StringType());
-            Select& offset(const StringType offset);
-            Select& columns(const StringType column, const StringType alias = StringType());
+            Select& where(const WHERE type, const StringRef lvalue, const StringRef op = StringRef(), const StringRef rvalue = StringRef());
+            Select& where(const StringRef lvalue, const StringRef op = StringRef(), const StringRef rvalue = StringRef());
+            Select& or_where(const StringRef lvalue, const StringRef op = StringRef(), const StringRef rvalue = StringRef());
+            Select& and_where(const StringRef lvalue, const StringRef op = StringRef(), const StringRef rvalue = StringRef());
+            // Where clauses with value bound to the placeholder
+            Select& where(const WHERE type, const StringRef lvalue, const StringRef op, const Param &rvalue);
+            Select& where(const StringRef lvalue, const StringRef op, const Param &rvalue);
+            Select& or_where(const StringRef lvalue, const StringRef op, const Param &rvalue);
+            Select& and_where(const StringRef lvalue, const StringRef op, const Param &rvalue);
+            Select& group_by(const StringRef column);
+            Select& group_by(const std::vector<StringType> columns);
+            // Having clauses, evaluated on groups (placeholders are bound after the ones of where clauses)
+            Select& having(const WHERE type, const StringRef lvalue, const StringRef op, const StringRef rvalue);
+            Select& having(const StringRef lvalue, const StringRef op, const StringRef rvalue);
+            Select& having(const WHERE type, const StringRef lvalue, const StringRef op, const Param &rvalue);
+            Select& having(const StringRef lvalue, const StringRef op, const Param &rvalue);
+            // Aggregate columns, alias defaults to name of the function and column (i.e. sum_amount)
+            Select& count(const StringRef column = "*", const StringRef alias = StringRef());
+            Select& sum(const StringRef column, const StringRef alias = StringRef());
+            Select& avg(const StringRef column, const StringRef alias = StringRef());
+            Select& min(const StringRef column, const StringRef alias = StringRef());
+            Select& max(const StringRef column, const StringRef alias = StringRef());
+            Select& group_concat(const StringRef column, const StringRef separator = ",", const StringRef alias = StringRef());
+            Select& order_by(const StringRef column, ORDER direction = ORDER::ASC);
+            Select& order_by(const std::vector<StringType> columns, ORDER direction = ORDER::ASC);
+            ColsInfo order_keys() const;
+            // Keyset pagination, rows following given values of order_by keys
+            Select& seek(const Params after);
+            Select& limit(const StringRef limit, const StringRef offset = StringRef());
+            Select& offset(const StringRef offset);
+            Select& limit(const unsigned long limit, const unsigned long offset = 0);
+            Select& offset(const unsigned long offset);
+            Select& clear_limit();
+            Select& clear_offset();
+            Select& columns(const StringRef column, const StringRef alias = StringRef());
             Select& columns(const Column col);
             Select& columns(const std::vector<StringType> cols);
             Select& columns(const std::vector<Column> cols);
             Select& clear();
-            // Having ?
+            static StringType column_name(const StringRef expr);
             // Joins
             Select& join(const Join& join);
         protected:
         private:
             // We allow only initialization using Factory pattern
             Select(const StringType &table_name = StringType(), const StringType &db_name = StringType("main.db"))
-                : _table_name(table_name)
+                : _table_name(table_name), _db_name(db_name)
             {
-                if( ! Select::_is_registred) // If connector is not registred, do it
-                {
-                    Select::_is_registred = true;
-                    Poco::Data::SQLite::Connector::registerConnector();
-                }
-                _ses = std::shared_ptr<Poco::Data::Session>(new Poco::Data::Session("SQLite", db_name));
+                _ses = SessionPool::get(db_name)->acquire();
+                _arena.reserve(256);
             }
 
-            /// Data for SQL where clause
-            typedef std::queue<std::tuple<WHERE, StringType>> WhereClauses;
+            /// Part of the query kept in the arena
+            struct Fragment {
+                std::size_t begin;
+                std::size_t size;
+            };
+            /// Data for SQL where clause, values are kept in _where_params
+            struct WhereClause {
+                WHERE type;
+                Fragment expr; /// Whole condition
+                Fragment lvalue; /// Left operand (whole condition if it was given as one string)
+                Fragment op; /// Operator (empty if it was given as a part of lvalue)
+                std::size_t params_begin;
+                std::size_t params_size;
+            };
+            typedef std::vector<WhereClause> WhereClauses;
+            /// Columns used for sorting, with direction
+            typedef std::vector<std::pair<Fragment, ORDER>> OrderKeys;
 
-            StringType _get_where();
-            StringType _get_columns();
+            Fragment _store(const StringRef text);
+            WhereClause _store_clause(const WHERE type, const StringRef lvalue, const StringRef op, const StringRef rvalue,
+                const std::size_t params_begin);
+            WhereClause _store_bound_clause(const WHERE type, const StringRef lvalue, const StringRef op, const std::size_t params_begin);
+            Select& _aggregate(const StringRef function, const StringRef column, const StringRef alias, const StringRef separator = StringRef());
+            StringRef _text(const Fragment &fragment) const { return StringRef(_arena).substr(fragment.begin, fragment.size); }
+            StringType& _append(StringType &query, const Fragment &fragment) const { return query.append(_arena, fragment.begin, fragment.size); }
+
+            void _get_clauses(StringType &query, const WhereClauses &clauses, const Params &values, Params &params) const;
+            void _get_where(StringType &query, Params &params) const;
+            void _get_group(StringType &query, Params &params) const;
+            void _get_seek(StringType &query, Params &params) const;
+            void _get_shard(StringType &query, Params &params) const;
+            /// Result of parallel_get() or get_from() part, order keys are merged by values with their storage class
+            struct Part {
+                Data rows;
+                Params keys; /// Values of order keys, row by row
+            };
+
+            static std::future<Part> _submit_part(AsyncExecutor &executor, const StringType &db_name, const CompiledQuery &query,
+                const std::vector<std::size_t> &key_cols);
+            std::vector<std::size_t> _merge_keys() const;
+            Data _merge(std::vector<Part> &parts) const;
+            void _cut_to_limit();
+            void _get_order(StringType &query) const;
+            void _get_columns(const StringType &table_name, StringType &query) const;
             ColsInfo _get_cols_for_userset();
-            StringType _get_joins();
-            StringType _construct_query(const StringType &table_name);
+            void _get_joins(StringType &query) const;
+            StringType _construct_query(const StringType &table_name, Params &params) const;
+            std::size_t _estimate_size(const StringType &table_name) const;
+            QueryShape _shape(StringType table_name);
+            QueryShape _shape(StringType table_name, QueryTrace &trace);
 
             StringType _table_name;
-            std::shared_ptr<Poco::Data::Session> _ses; /// Database session
+            StringType _db_name;
+            SessionPool::SessionPtr _ses; /// Database session borrowed from the pool
             ColsInfo _cols_list;  /// List of column names
             ColsInfo _cols_types; /// List of column types
             Data _table_data; /// Data read from table with the last request
+            StringType _arena; /// Fragments of the query (columns, clauses, ...) one after another, reused after clear()
             WhereClauses _where; /// Data for SQL where clauses
+            Params _where_params; /// Values bound in where clauses
             bool _distinct = false; /// Select type (ALL/DISTINCT)
-            StringType _group_by = StringType();
-            StringType _order_by = StringType();
-            StringType _limit = StringType();
-            StringType _offset = StringType();
-            Columns _columns;
-            std::queue<Join> _joins; /// Parts of join clause
-
-            static bool _is_registred; /// Is database Connector registred?
+            std::vector<Fragment> _group_by; /// Columns used for grouping
+            WhereClauses _having; /// Data for SQL having clauses
+            Params _having_params; /// Values bound in having clauses
+            OrderKeys _order_by;
+            Params _seek_after; /// Order keys of the last row of previous page (empty - first page)
+            StringType _shard_key; /// Key of the range read by parallel_get() worker
+            Params _shard_from; /// Lower bound of the range (empty - unbounded)
+            Params _shard_to; /// Upper bound of the range, exclusive (empty - unbounded)
+            Fragment _limit = Fragment();
+            Fragment _offset = Fragment();
+            Params _limit_param; /// Value bound to LIMIT placeholder (if used)
+            Params _offset_param; /// Value bound to OFFSET placeholder (if used)
+            std::vector<std::pair<Fragment, Fragment>> _columns; /// Columns and their aliases
+            std::vector<Join> _joins; /// Parts of join clause
+            std::chrono::milliseconds _cache_ttl = std::chrono::milliseconds(0); /// Results are cached if greater than 0
     };
 
     /**
-     * Number of queries executed
+     * Number of queries executed (all threads)
+     * Timings per query shape are collected by QueryMetrics
      */
     class QueryCounter {
         friend class Select;
+        friend class CompiledQuery;
+        friend class Batch;
+        friend class StaticQuery;
+        friend class Insert;
         public:
             static unsigned get() { return _count; };
         private:
-            static void inc() { _count++; };
-            static unsigned _count;
+            static void inc() { _count.fetch_add(1, std::memory_order_relaxed); };
+            static std::atomic<unsigned> _count;
     };
+
+    /**
+     * Prepared statement cache usage (all sessions)
+     */
+    class StatementCounter {
+        friend class StatementCache;
+        public:
+            static unsigned long hits() { return _hits; };
+            static unsigned long misses() { return _misses; };
+            static double hit_rate()
+            {
+                const unsigned long total = _hits + _misses;
+                return total != 0 ? static_cast<double>(_hits) / total : 0.0;
+            };
+        private:
+            static void hit() { _hits++; };
+            static void miss() { _misses++; };
+            static std::atomic<unsigned long> _hits;
+            static std::atomic<unsigned long> _misses;
+    };
+
+    /**
+     * Getting data from table directly into user types (std::tuple or struct described with DB_ROW_MAPPING)
+     * Values are extracted by Poco::Data::TypeHandler<T>, without converting them to strings
+     *
+     * @param  StringType table_name name of table
+     * @return rows of the result
+     */
+    template <typename T>
+    std::vector<T> Select::get_as(StringType table_name)
+    {
+        using namespace Poco::Data;
+
+        if(_columns.empty())
+            columns(RowMapping<T>::columns());
+        assert(_columns.empty() or _columns.size() == TypeHandler<T>::size());
+        QueryTrace trace;
+        const auto shape = _shape(table_name, trace);
+        std::vector<T> res;
+        Statement select(_ses->session);
+        select << shape.text;
+        for(const auto &param : shape.params)
+            select, use(param);
+        select, into(res);
+        trace.mark(STAGE::PREPARE);
+        // Values are extracted into res during execution
+        select.execute();
+        QueryCounter::inc();
+        trace.mark(STAGE::EXECUTE);
+        trace.finish(res.size(), res.size() * sizeof(T));
+        SlowQueryLog::check(*_ses, shape, trace, res.size());
+
+        return res;
+    }
 }
 #endif // DBREFLECTIONHELPER_H
@@ -0,0 +1,73 @@
+#ifndef INDEXADVISOR_H
+#define INDEXADVISOR_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include "DBReflectionHelper.h"
+
+namespace DB
+{
+    /**
+     * Suggesting indexes for a workload of queries
+     * Columns used by each query (equality conditions, sort keys, range condition, other read columns) are compared
+     * with existing indexes (PRAGMA index_list/index_xinfo) and with the plan chosen by SQLite (EXPLAIN QUERY PLAN).
+     * Suggested index removes the sort (USE TEMP B-TREE) and, when it's covering, lookups of the table rows.
+     * Usage: advisor.add(select1).add(select2); for(const auto &advice : advisor.advise()) std::cout << IndexAdvisor::format(advice);
+     */
+    class IndexAdvisor
+    {
+        public:
+            /// Max number of columns of suggested covering index, wider queries get index of the key columns only
+            static const std::size_t MAX_COLUMNS = 8;
+
+            /// Columns of the table used by the query
+            struct Usage {
+                StringType table;
+                ColsInfo equality; /// Compared with =, IS or IN
+                ColsInfo range; /// Compared with < > BETWEEN LIKE etc.
+                std::vector<std::pair<StringType, ORDER>> order; /// Sort keys (or grouping, if query is not sorted)
+                ColsInfo columns; /// Other columns read by the query
+                bool all_columns = false; /// SELECT * or expressions which couldn't be inspected, index can't be covering
+            };
+
+            /// Suggestion for one query
+            struct Advice {
+                StringType sql;
+                StringType plan; /// Plan steps separated with " | "
+                bool temp_btree = false; /// Sorting or grouping uses temporary B-tree
+                bool table_scan = false; /// Table is read without index
+                StringType existing; /// Existing index which already serves the query
+                ColsInfo index; /// Columns of suggested index (DESC keys with suffix), empty - nothing to suggest
+                bool covering = false; /// Suggested index contains all columns used by the query
+                StringType ddl; /// CREATE INDEX statement (empty if existing index is good enough)
+            };
+
+            explicit IndexAdvisor(const StringType &db_name = StringType("main.db")) : _db_name(db_name) {}
+
+            IndexAdvisor& add(Select &select, const StringType &table_name = StringType());
+            std::vector<Advice> advise();
+            std::size_t size() const { return _queries.size(); }
+            IndexAdvisor& clear();
+
+            static Usage usage(const Select &select, const StringType &table_name = StringType());
+            static ColsInfo candidate(const Usage &usage, bool &covering);
+            static StringType ddl(const StringType &table, const ColsInfo &index);
+            static std::string format(const Advice &advice);
+        private:
+            /// Captured query with its structure
+            struct Query {
+                QueryShape shape;
+                Usage usage;
+            };
+            typedef std::map<StringType, ColsInfo> Indexes; /// Key columns of full indexes by their names (with DESC suffix for descending keys)
+
+            static Usage _known_columns(const Usage &usage, const ColsInfo &names);
+            static StringType _serving_index(const Indexes &indexes, const Usage &usage, const ColsInfo &index);
+            static Indexes _indexes(Connection &connection, const StringType &table);
+
+            StringType _db_name;
+            std::vector<Query> _queries;
+    };
+}
+#endif // INDEXADVISOR_H
@@ -0,0 +1,82 @@
+#ifndef INSERT_H
+#define INSERT_H
+
+#include <string>
+#include <vector>
+#include <boost/utility/string_ref.hpp>
+#include "SessionPool.h"
+#include "Param.h"
+
+namespace DB
+{
+    /// Action taken when inserted row violates a constraint (INSERT OR ...)
+    enum class CONFLICT { ABORT, IGNORE, REPLACE };
+    /// Values of PRAGMA synchronous, DEFAULT - setting of the session is not changed
+    enum class SYNCHRONOUS { DEFAULT, OFF, NORMAL, FULL };
+
+    /**
+     * Bulk INSERT/UPSERT builder
+     * Rows are sent as multi-row VALUES (up to SQLite's limit of bound variables per statement),
+     * inside a transaction committed every N rows. Statements are prepared once per session.
+     * Usage: Insert::factory("table").columns({"id", "name"}).values(1, std::string("a")).values(2, std::string("b")).execute();
+     */
+    class Insert
+    {
+        public:
+            /// SQLITE_MAX_VARIABLE_NUMBER of SQLite builds older than 3.32
+            static const std::size_t MAX_VARIABLES = 999;
+
+            static Insert factory(const std::string &table_name, const std::string &db_name = std::string("main.db"));
+            const std::string& db_name() const { return _db_name; }
+            Insert& columns(const boost::string_ref column);
+            Insert& columns(const std::vector<std::string> cols);
+            Insert& values(const Params &row);
+            /// Row given as values of the columns, in order: values(1, std::string("name"), 2.5)
+            template <typename... Args>
+            Insert& values(const Args&... args)
+            {
+                _rows.reserve(_rows.size() + sizeof...(Args));
+                _push(args...);
+                return (*this);
+            }
+            Insert& on_conflict(const CONFLICT action);
+            Insert& upsert(const std::vector<std::string> keys, const std::vector<std::string> update = std::vector<std::string>());
+            Insert& commit_every(const std::size_t rows);
+            Insert& rows_per_statement(const std::size_t rows);
+            Insert& journal_wal(const bool wal = true);
+            Insert& synchronous(const SYNCHRONOUS mode);
+            std::size_t size() const { return _columns.empty() ? 0 : _rows.size() / _columns.size(); }
+            std::string sql(const std::size_t rows) const;
+            std::size_t execute();
+            Insert& clear();
+        private:
+            // We allow only initialization using Factory pattern
+            Insert(const std::string &table_name, const std::string &db_name);
+
+            void _push() {}
+            template <typename T, typename... Args>
+            void _push(const T &value, const Args&... args)
+            {
+                _rows.push_back(Param(value));
+                _push(args...);
+            }
+            std::size_t _chunk_rows() const;
+            int _apply_pragmas();
+            void _finish(const int previous_synchronous);
+            std::string _pragma() const;
+
+            std::string _table_name;
+            std::string _db_name;
+            SessionPool::SessionPtr _ses; /// Database session borrowed from the pool
+            std::vector<std::string> _columns;
+            Params _rows; /// Values of all rows, one after another
+            CONFLICT _conflict = CONFLICT::ABORT;
+            std::vector<std::string> _upsert_keys; /// Conflict target of ON CONFLICT (empty - no upsert)
+            std::vector<std::string> _upsert_update; /// Columns updated on conflict (empty - all but the keys)
+            std::size_t _commit_every = 0; /// Rows per transaction, 0 - whole execute() in one transaction
+            std::size_t _rows_per_statement = 0; /// 0 - as many as fit into MAX_VARIABLES
+            bool _wal = false;
+            SYNCHRONOUS _synchronous = SYNCHRONOUS::DEFAULT;
+    };
+}
+#endif // INSERT_H
@@ -0,0 +1,37 @@
+#ifndef KEYSETPAGER_H
+#define KEYSETPAGER_H
+
+#include <string>
+#include "DBReflectionHelper.h"
+
+namespace DB
+{
+    /**
+     * Reading the result page by page using keyset pagination (Select::seek)
+     * Every page starts right after the last row of the previous one, so deep pages are as cheap as the first
+     * Select has to be sorted (order_by) by keys which are present in the result, identify rows uniquely (NULL keys are allowed)
+     * Limit and offset of the select are not used
+     */
+    class KeysetPager
+    {
+        public:
+            KeysetPager(const Select &select, const std::size_t page_size, const StringType &table_name = StringType());
+
+            bool next();
+            const Data& page() const { return _page; }
+            /// Values of order keys in the last row read, can be stored to resume reading later
+            const Params& last_key() const { return _last_key; }
+            KeysetPager& resume(const Params &last_key);
+        private:
+            Param _value(const ColumnarData &data, const StringType &key) const;
+
+            Select _select;
+            std::size_t _page_size;
+            StringType _table_name;
+            ColsInfo _keys;
+            Params _last_key;
+            Data _page;
+            bool _done = false;
+    };
+}
+#endif // KEYSETPAGER_H
@@ -0,0 +1,92 @@
+#ifndef PARAM_H
+#define PARAM_H
+
+#include <string>
+#include <vector>
+#include "Poco/Data/Common.h"
+#include "Poco/Data/BLOB.h"
+#include "Poco/DateTime.h"
+#include "Poco/Exception.h"
+
+namespace DB
+{
+    /**
+     * Value bound to the '?' placeholder of the statement
+     */
+    class Param
+    {
+        public:
+            /// Storage classes of SQLite values
+            enum class TYPE { INTEGER, REAL, TEXT, BLOB, NONE };
+
+            /// NULL, only order keys of Select::seek() can be NULL (they are rendered as IS NULL instead of bound)
+            Param() : _type(TYPE::NONE) {}
+
+            Param(const int val) : _type(TYPE::INTEGER), _int(val) {}
+            Param(const long val) : _type(TYPE::INTEGER), _int(val) {}
+            Param(const long long val) : _type(TYPE::INTEGER), _int(val) {}
+            Param(const unsigned val) : _type(TYPE::INTEGER), _int(val) {}
+            Param(const unsigned long val) : _type(TYPE::INTEGER), _int(static_cast<Poco::Int64>(val)) {}
+            Param(const unsigned long long val) : _type(TYPE::INTEGER), _int(static_cast<Poco::Int64>(val)) {}
+            Param(const double val) : _type(TYPE::REAL), _real(val) {}
+            Param(const Poco::Data::BLOB &val) : _type(TYPE::BLOB), _blob(val) {}
+            Param(const Poco::DateTime &val);
+            /// Strings are explicit, so they can't be confused with raw SQL fragments
+            explicit Param(const std::string &val) : _type(TYPE::TEXT), _text(val) {}
+
+            TYPE type() const { return _type; }
+            bool is_null() const { return _type == TYPE::NONE; }
+            Poco::Int64 as_int() const { return _int; }
+            double as_real() const { return _real; }
+            const std::string& as_text() const { return _text; }
+            const Poco::Data::BLOB& as_blob() const { return _blob; }
+            std::string to_string() const;
+        private:
+            TYPE _type;
+            Poco::Int64 _int = 0;
+            double _real = 0.0;
+            std::string _text;
+            Poco::Data::BLOB _blob;
+    };
+
+    /// Values of all placeholders in the statement
+    typedef std::vector<Param> Params;
+}
+
+namespace Poco {
+namespace Data {
+    /**
+     * Binding DB::Param using its actual storage class
+     */
+    template <>
+    class TypeHandler<DB::Param>
+    {
+        public:
+            static void bind(std::size_t pos, const DB::Param &obj, AbstractBinder *pBinder)
+            {
+                switch(obj.type())
+                {
+                    case DB::Param::TYPE::INTEGER: pBinder->bind(pos, obj.as_int()); break;
+                    case DB::Param::TYPE::REAL: pBinder->bind(pos, obj.as_real()); break;
+                    case DB::Param::TYPE::TEXT: pBinder->bind(pos, obj.as_text()); break;
+                    case DB::Param::TYPE::BLOB: pBinder->bind(pos, obj.as_blob()); break;
+                    case DB::Param::TYPE::NONE: throw Poco::InvalidArgumentException("NULL value can't be bound");
+                }
+            }
+
+            static std::size_t size() { return 1; }
+
+            static void extract(std::size_t pos, DB::Param &obj, const DB::Param &defVal, AbstractExtractor *pExt)
+            {
+                std::string val;
+                obj = pExt->extract(pos, val) ? DB::Param(val) : defVal;
+            }
+
+            static void prepare(std::size_t pos, const DB::Param &obj, AbstractPreparation *pPrepare)
+            {
+                pPrepare->prepare(pos, obj.to_string());
+            }
+    };
+} // namespace Data
+} // namespace Poco
+#endif // PARAM_H
@@ -0,0 +1,109 @@
+#ifndef QUERYMETRICS_H
+#define QUERYMETRICS_H
+
+#include <string>
+#include <vector>
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+namespace DB
+{
+    /// Stages of query execution
+    enum class STAGE { BUILD, PREPARE, EXECUTE, FETCH, CONVERT };
+
+    /**
+     * Lock-free histogram of stage durations
+     */
+    class LatencyHistogram
+    {
+        public:
+            static constexpr std::size_t BUCKETS = 14;
+            /// Upper bounds of buckets in microseconds, the last bucket is unbounded
+            static const std::array<unsigned long, BUCKETS - 1> BOUNDS;
+
+            struct Snapshot {
+                std::array<unsigned long, BUCKETS> buckets; /// Not cumulative
+                unsigned long count = 0;
+                unsigned long long sum_us = 0;
+            };
+
+            LatencyHistogram();
+            void record(const std::chrono::microseconds duration);
+            Snapshot snapshot() const;
+        private:
+            std::array<std::atomic<unsigned long>, BUCKETS> _buckets;
+            std::atomic<unsigned long> _count;
+            std::atomic<unsigned long long> _sum_us;
+    };
+
+    /**
+     * Execution statistics collected per query shape (normalized SQL)
+     */
+    class QueryMetrics
+    {
+        public:
+            static constexpr std::size_t STAGES = 5;
+
+            struct Snapshot {
+                std::string sql;
+                unsigned long count = 0; /// Executions
+                unsigned long long rows = 0; /// Rows returned
+                unsigned long long bytes = 0; /// Bytes of values materialized
+                std::array<LatencyHistogram::Snapshot, STAGES> stages;
+            };
+
+            static void enable(const bool enabled) { _enabled = enabled; }
+            static bool enabled() { return _enabled; }
+            static void record(const std::string &sql, const STAGE stage, const std::chrono::microseconds duration);
+            static void record_execution(const std::string &sql, const unsigned long long rows, const unsigned long long bytes);
+            static std::vector<Snapshot> snapshot();
+            static std::string prometheus();
+            static void reset();
+        private:
+            friend class QueryTrace;
+
+            /// Counters of one query shape
+            struct Entry {
+                Entry() : count(0), rows(0), bytes(0) {}
+                std::atomic<unsigned long> count;
+                std::atomic<unsigned long long> rows;
+                std::atomic<unsigned long long> bytes;
+                std::array<LatencyHistogram, STAGES> stages;
+            };
+
+            static std::shared_ptr<Entry> _entry(const std::string &sql);
+
+            static std::map<std::string, std::shared_ptr<Entry>> _entries;
+            static std::mutex _mutex;
+            static std::atomic<bool> _enabled;
+    };
+
+    /**
+     * Measuring stages of single query execution
+     * Each mark() records time elapsed since the previous mark (or since creation)
+     * Trace created before the query is built gets its shape later with shape()
+     */
+    class QueryTrace
+    {
+        public:
+            typedef std::chrono::steady_clock Clock;
+
+            QueryTrace();
+            explicit QueryTrace(const std::string &sql);
+            void shape(const std::string &sql);
+            void mark(const STAGE stage);
+            void finish(const unsigned long long rows, const unsigned long long bytes);
+            std::chrono::microseconds total() const { return _total; }
+            std::chrono::microseconds stage(const STAGE stage) const { return _stages[static_cast<std::size_t>(stage)]; }
+        private:
+            std::shared_ptr<QueryMetrics::Entry> _entry; /// Counters of the query shape (null if metrics are disabled), kept alive over reset()
+            Clock::time_point _last;
+            std::chrono::microseconds _total = std::chrono::microseconds(0);
+            std::array<std::chrono::microseconds, QueryMetrics::STAGES> _stages {};
+    };
+}
+#endif // QUERYMETRICS_H
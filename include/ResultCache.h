@@ -0,0 +1,78 @@
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include "CompiledQuery.h"
+
+namespace DB
+{
+    /**
+     * In-process cache of query results, keyed by compiled query and its values
+     * Entries expire after their TTL, least recently used are dropped when memory budget is exceeded.
+     * Entries are invalidated per table, explicitly or when PRAGMA data_version reports changes made by others.
+     * Values of data_version are comparable only within one connection, so they are kept for every connection
+     * which checked the database. The first check through a connection invalidates the database too.
+     */
+    class ResultCache
+    {
+        public:
+            typedef std::chrono::steady_clock Clock;
+            typedef CompiledQuery::Data Data;
+
+            struct Config {
+                std::size_t memory_budget = 64 * 1024 * 1024; /// Bytes of cached data
+                bool check_data_version = false; /// Run PRAGMA data_version before using cached entry
+            };
+
+            struct Stats {
+                unsigned long hits = 0;
+                unsigned long misses = 0;
+                unsigned long evicted = 0;
+                std::size_t entries = 0;
+                std::size_t memory = 0;
+            };
+
+            static void configure(const Config &config);
+            static std::shared_ptr<const Data> lookup(Connection &connection, const std::string &db_name, const CompiledQuery &query);
+            static void store(const std::string &db_name, const CompiledQuery &query, const std::vector<std::string> &tables,
+                const Data &data, const std::chrono::milliseconds ttl);
+            static void invalidate(const std::string &db_name, const std::string &table_name);
+            static void clear();
+            static Stats stats();
+        private:
+            struct Entry {
+                std::string key;
+                std::string db_name;
+                std::vector<std::string> tables;
+                std::shared_ptr<const Data> data;
+                std::size_t size;
+                Clock::time_point expires;
+            };
+            typedef std::list<Entry> Entries;
+
+            typedef std::pair<std::string, unsigned long> VersionKey; /// Database name and Connection::id
+
+            static std::string _key(const std::string &db_name, const CompiledQuery &query);
+            static void _check_data_version(Connection &connection, const std::string &db_name);
+            static void _invalidate(const std::string &db_name, const std::string &table_name);
+            static void _erase(Entries::iterator it);
+
+            static Config _config;
+            static Entries _entries; /// Most recently used at the front
+            static std::unordered_map<std::string, Entries::iterator> _index;
+            static std::map<VersionKey, int> _data_versions; /// PRAGMA data_version seen by the last check
+            static std::size_t _memory;
+            static Stats _stats;
+            static std::mutex _mutex;
+    };
+
+    void invalidate(const std::string &table_name, const std::string &db_name = std::string("main.db"));
+}
+#endif // RESULTCACHE_H
@@ -0,0 +1,43 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include "DBReflectionHelper.h"
+
+namespace DB
+{
+    /**
+     * Routing reads to read-only replicas of the database (copies of the file, opened with mode=ro or immutable=1)
+     * Every replica has its own session pool, so readers are spread across files instead of waiting for one pool.
+     * Writes (Insert, DDL) always use the primary database, replicas have to be refreshed by the application.
+     * Replica URIs need SQLite with URI filenames enabled (SQLITE_USE_URI=1), otherwise they are taken as file names.
+     * Usage: Router::add_replica("main.db", Router::replica_uri("copy1.db")); Router::select("Users", "main.db").get();
+     */
+    class Router
+    {
+        public:
+            static std::string replica_uri(const std::string &file, const bool immutable = true);
+            static void add_replica(const std::string &db_name, const std::string &replica);
+            static void remove_replicas(const std::string &db_name);
+            static std::vector<std::string> replicas(const std::string &db_name);
+            static std::string route(const std::string &db_name);
+            /// Builder reading from the replica chosen by route()
+            static Select select(const StringType &table_name, const StringType &db_name = StringType("main.db"))
+            {
+                return Select::factory(table_name, route(db_name));
+            }
+        private:
+            /// Replicas of one database
+            struct Replicas {
+                std::vector<std::string> names;
+                std::size_t next = 0; /// Replica checked first by the next route()
+            };
+
+            static std::map<std::string, Replicas> _replicas;
+            static std::mutex _mutex;
+    };
+}
+#endif // ROUTER_H
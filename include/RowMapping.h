@@ -0,0 +1,129 @@
+#ifndef ROWMAPPING_H
+#define ROWMAPPING_H
+
+#include <string>
+#include <vector>
+#include <tuple>
+#include <boost/preprocessor/seq/for_each.hpp>
+#include <boost/preprocessor/seq/transform.hpp>
+#include <boost/preprocessor/seq/enum.hpp>
+#include <boost/preprocessor/stringize.hpp>
+#include "Poco/Data/Common.h"
+
+namespace DB
+{
+    /**
+     * Columns read into the user type by Select::get_as<T>()
+     * Specialized by DB_ROW_MAPPING, for other types (i.e. std::tuple) columns set in Select are used
+     */
+    template <typename T>
+    struct RowMapping {
+        static std::vector<std::string> columns() { return std::vector<std::string>(); }
+    };
+
+    namespace detail
+    {
+        /// Visiting tuple elements I..N-1, each with its own TypeHandler
+        template <std::size_t I, std::size_t N>
+        struct TupleFields {
+            template <typename Tuple>
+            static std::size_t size()
+            {
+                typedef typename std::tuple_element<I, Tuple>::type Field;
+                return Poco::Data::TypeHandler<Field>::size() + TupleFields<I + 1, N>::template size<Tuple>();
+            }
+
+            template <typename Tuple>
+            static void bind(std::size_t pos, const Tuple &obj, Poco::Data::AbstractBinder *pBinder)
+            {
+                typedef typename std::tuple_element<I, Tuple>::type Field;
+                Poco::Data::TypeHandler<Field>::bind(pos, std::get<I>(obj), pBinder);
+                TupleFields<I + 1, N>::bind(pos + Poco::Data::TypeHandler<Field>::size(), obj, pBinder);
+            }
+
+            template <typename Tuple>
+            static void extract(std::size_t pos, Tuple &obj, const Tuple &defVal, Poco::Data::AbstractExtractor *pExt)
+            {
+                typedef typename std::tuple_element<I, Tuple>::type Field;
+                Poco::Data::TypeHandler<Field>::extract(pos, std::get<I>(obj), std::get<I>(defVal), pExt);
+                TupleFields<I + 1, N>::extract(pos + Poco::Data::TypeHandler<Field>::size(), obj, defVal, pExt);
+            }
+
+            template <typename Tuple>
+            static void prepare(std::size_t pos, const Tuple &obj, Poco::Data::AbstractPreparation *pPrepare)
+            {
+                typedef typename std::tuple_element<I, Tuple>::type Field;
+                Poco::Data::TypeHandler<Field>::prepare(pos, std::get<I>(obj), pPrepare);
+                TupleFields<I + 1, N>::prepare(pos + Poco::Data::TypeHandler<Field>::size(), obj, pPrepare);
+            }
+        };
+
+        template <std::size_t N>
+        struct TupleFields<N, N> {
+            template <typename Tuple> static std::size_t size() { return 0; }
+            template <typename Tuple> static void bind(std::size_t, const Tuple&, Poco::Data::AbstractBinder*) {}
+            template <typename Tuple> static void extract(std::size_t, Tuple&, const Tuple&, Poco::Data::AbstractExtractor*) {}
+            template <typename Tuple> static void prepare(std::size_t, const Tuple&, Poco::Data::AbstractPreparation*) {}
+        };
+    }
+}
+
+namespace Poco {
+namespace Data {
+    /**
+     * Reading std::tuple directly from the statement, one column per element
+     */
+    template <typename... Ts>
+    class TypeHandler<std::tuple<Ts...>>
+    {
+        typedef std::tuple<Ts...> Tuple;
+        typedef DB::detail::TupleFields<0, sizeof...(Ts)> Fields;
+        public:
+            static std::size_t size() { return Fields::template size<Tuple>(); }
+            static void bind(std::size_t pos, const Tuple &obj, AbstractBinder *pBinder) { Fields::bind(pos, obj, pBinder); }
+            static void extract(std::size_t pos, Tuple &obj, const Tuple &defVal, AbstractExtractor *pExt) { Fields::extract(pos, obj, defVal, pExt); }
+            static void prepare(std::size_t pos, const Tuple &obj, AbstractPreparation *pPrepare) { Fields::prepare(pos, obj, pPrepare); }
+    };
+} // namespace Data
+} // namespace Poco
+
+#define DB_ROW_FIELD_SIZE(r, TYPE, FIELD) + TypeHandler<decltype(TYPE::FIELD)>::size()
+#define DB_ROW_FIELD_BIND(r, TYPE, FIELD) \
+    TypeHandler<decltype(TYPE::FIELD)>::bind(pos, obj.FIELD, pBinder); \
+    pos += TypeHandler<decltype(TYPE::FIELD)>::size();
+#define DB_ROW_FIELD_EXTRACT(r, TYPE, FIELD) \
+    TypeHandler<decltype(TYPE::FIELD)>::extract(pos, obj.FIELD, defVal.FIELD, pExt); \
+    pos += TypeHandler<decltype(TYPE::FIELD)>::size();
+#define DB_ROW_FIELD_PREPARE(r, TYPE, FIELD) \
+    TypeHandler<decltype(TYPE::FIELD)>::prepare(pos, obj.FIELD, pPrepare); \
+    pos += TypeHandler<decltype(TYPE::FIELD)>::size();
+#define DB_ROW_FIELD_NAME(s, data, FIELD) BOOST_PP_STRINGIZE(FIELD)
+
+/**
+ * Describe struct read by Select::get_as<T>(), fields are mapped to the columns of the same name
+ * Use in the global namespace: DB_ROW_MAPPING(Account, (id)(name)(balance))
+ */
+#define DB_ROW_MAPPING(TYPE, FIELDS) \
+    namespace Poco { namespace Data { \
+    template <> \
+    class TypeHandler<TYPE> \
+    { \
+        public: \
+            static std::size_t size() { return 0 BOOST_PP_SEQ_FOR_EACH(DB_ROW_FIELD_SIZE, TYPE, FIELDS); } \
+            static void bind(std::size_t pos, const TYPE &obj, AbstractBinder *pBinder) \
+            { BOOST_PP_SEQ_FOR_EACH(DB_ROW_FIELD_BIND, TYPE, FIELDS) } \
+            static void extract(std::size_t pos, TYPE &obj, const TYPE &defVal, AbstractExtractor *pExt) \
+            { BOOST_PP_SEQ_FOR_EACH(DB_ROW_FIELD_EXTRACT, TYPE, FIELDS) } \
+            static void prepare(std::size_t pos, const TYPE &obj, AbstractPreparation *pPrepare) \
+            { BOOST_PP_SEQ_FOR_EACH(DB_ROW_FIELD_PREPARE, TYPE, FIELDS) } \
+    }; \
+    } } \
+    namespace DB { \
+    template <> \
+    struct RowMapping<TYPE> { \
+        static std::vector<std::string> columns() \
+        { return { BOOST_PP_SEQ_ENUM(BOOST_PP_SEQ_TRANSFORM(DB_ROW_FIELD_NAME, _, FIELDS)) }; } \
+    }; \
+    }
+
+#endif // ROWMAPPING_H
@@ -0,0 +1,48 @@
+#ifndef SCHEMACACHE_H
+#define SCHEMACACHE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include "SessionPool.h"
+
+namespace DB
+{
+    /**
+     * Shared cache of table columns (names and types), so SELECT * doesn't need PRAGMA TABLE_INFO every time
+     * Entries are checked against SQLite's schema_version, at most once per check interval
+     * Tables of attached databases are named with the schema: "archive.Users"
+     */
+    class SchemaCache
+    {
+        public:
+            typedef std::chrono::steady_clock Clock;
+
+            /// Columns of the table
+            struct TableInfo {
+                std::vector<std::string> names;
+                std::vector<std::string> types;
+                int schema_version = 0;
+                Clock::time_point checked;
+            };
+
+            static TableInfo get(Connection &connection, const std::string &db_name, const std::string &table_name);
+            static void invalidate(const std::string &db_name, const std::string &table_name = std::string());
+            static void warm(const std::string &db_name, const std::vector<std::string> &tables);
+            static void set_check_interval(const std::chrono::milliseconds interval);
+            static std::pair<std::string, std::string> split(const std::string &table_name);
+            static std::string quote(const std::string &table_name);
+        private:
+            typedef std::pair<std::string, std::string> Key; /// Database and table names
+
+            static TableInfo _load(Connection &connection, const std::string &table_name);
+            static int _schema_version(Connection &connection, const std::string &schema = std::string());
+
+            static std::map<Key, TableInfo> _tables;
+            static std::chrono::milliseconds _check_interval;
+            static std::mutex _mutex;
+    };
+}
+#endif // SCHEMACACHE_H
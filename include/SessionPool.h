@@ -0,0 +1,106 @@
+#ifndef SESSIONPOOL_H
+#define SESSIONPOOL_H
+
+#include <string>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+#include "Poco/Data/Common.h"
+#include "StatementCache.h"
+
+namespace DB
+{
+    void register_connector();
+
+    /**
+     * Database session together with statements prepared on it
+     */
+    struct Connection {
+        explicit Connection(const std::string &db_name);
+        Connection(const Connection&) = delete;
+        Connection& operator=(const Connection&) = delete;
+
+        void attach(const std::map<std::string, std::string> &databases);
+
+        Poco::Data::Session session;
+        StatementCache statements; /// Destroyed before the session
+        const unsigned long id; /// Unique in the process, also after the connection is closed
+        std::map<std::string, std::string> attached; /// Databases attached to the session: schema name -> file
+    };
+
+    /**
+     * Process-wide pool of database sessions, one pool per database file
+     * Sessions are borrowed using acquire() and go back to the pool when the last copy of the handle is destroyed
+     */
+    class SessionPool : public std::enable_shared_from_this<SessionPool>
+    {
+        public:
+            typedef std::chrono::steady_clock Clock;
+            /// Handle of the borrowed session
+            typedef std::shared_ptr<Connection> SessionPtr;
+
+            /// Pool limits
+            struct Config {
+                std::size_t min_size = 1; /// Sessions kept open even when idle
+                std::size_t max_size = 16; /// Sessions open at once (idle + borrowed)
+                std::chrono::milliseconds idle_time = std::chrono::seconds(60); /// Idle time after which session is closed
+                std::chrono::milliseconds checkout_timeout = std::chrono::seconds(5); /// Max time of waiting for free session
+                std::map<std::string, std::string> attached; /// Databases attached to every session: schema name -> file
+            };
+
+            /// Usage statistics
+            struct Stats {
+                unsigned long hits = 0; /// Idle session reused
+                unsigned long misses = 0; /// New session opened
+                unsigned long waits = 0; /// Caller had to wait for free session
+                unsigned long timeouts = 0; /// Caller gave up waiting
+                unsigned long evicted = 0; /// Idle sessions closed
+                std::size_t idle = 0;
+                std::size_t used = 0;
+            };
+
+            static std::shared_ptr<SessionPool> get(const std::string &db_name);
+            static void configure(const std::string &db_name, const Config &config);
+            static void set_default_config(const Config &config);
+            static void attach(const std::string &db_name, const std::string &schema, const std::string &file);
+            static void shutdown_all();
+
+            SessionPtr acquire();
+            void evict_idle();
+            Stats stats() const;
+            const std::string& db_name() const { return _db_name; }
+
+            SessionPool(const SessionPool&) = delete;
+            SessionPool& operator=(const SessionPool&) = delete;
+            ~SessionPool();
+        private:
+            SessionPool(const std::string &db_name, const Config &config);
+
+            /// Session waiting in the pool
+            struct Idle {
+                Connection *session;
+                Clock::time_point since;
+            };
+
+            void _release(Connection *session);
+            void _collect_expired(std::vector<std::unique_ptr<Connection>> &expired);
+
+            const std::string _db_name;
+            Config _config;
+            std::deque<Idle> _idle; /// Most recently returned sessions at the back
+            std::size_t _used = 0; /// Borrowed sessions and sessions being opened
+            mutable std::mutex _mutex;
+            std::condition_variable _available;
+
+            std::atomic<unsigned long> _hits, _misses, _waits, _timeouts, _evicted;
+
+            static std::map<std::string, std::shared_ptr<SessionPool>> _pools;
+            static Config _default_config;
+            static std::mutex _pools_mutex;
+    };
+}
+#endif // SESSIONPOOL_H
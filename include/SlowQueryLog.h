@@ -0,0 +1,51 @@
+#ifndef SLOWQUERYLOG_H
+#define SLOWQUERYLOG_H
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <ostream>
+#include "SessionPool.h"
+#include "StatementCache.h"
+#include "QueryMetrics.h"
+
+namespace DB
+{
+    /**
+     * Logging queries which took longer than the threshold, together with their EXPLAIN QUERY PLAN
+     * Plan is captured only once per query shape. Logging is disabled until threshold is set.
+     */
+    class SlowQueryLog
+    {
+        public:
+            /// Details of the slow execution
+            struct Entry {
+                std::string sql;
+                Params params;
+                unsigned long long rows = 0;
+                std::chrono::microseconds total;
+                std::array<std::chrono::microseconds, QueryMetrics::STAGES> stages;
+                std::string plan; /// One line per plan step
+            };
+            typedef std::function<void(const Entry&)> Sink;
+
+            static void set_threshold(const std::chrono::microseconds threshold);
+            static void disable();
+            static void set_sink(const Sink &sink);
+            static void set_stream(std::ostream &out);
+            static std::string format(const Entry &entry);
+
+            static void check(Connection &connection, const QueryShape &shape, const QueryTrace &trace, const unsigned long long rows);
+            static std::string explain(Connection &connection, const QueryShape &shape);
+        private:
+
+            static std::atomic<long long> _threshold_us; /// Negative - disabled
+            static Sink _sink;
+            static std::map<std::string, std::string> _plans; /// Captured plans by query shape
+            static std::mutex _mutex;
+    };
+}
+#endif // SLOWQUERYLOG_H
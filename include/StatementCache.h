@@ -0,0 +1,61 @@
+#ifndef STATEMENTCACHE_H
+#define STATEMENTCACHE_H
+
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <atomic>
+#include "Poco/Data/Common.h"
+#include "Param.h"
+
+namespace DB
+{
+    /**
+     * Query with literals replaced by placeholders and values of all placeholders
+     */
+    struct QueryShape {
+        std::string text;
+        Params params;
+    };
+
+    QueryShape normalize(const std::string &query, const Params &bound = Params());
+
+    /**
+     * LRU cache of prepared statements for one database session
+     * Statements are keyed by normalized query text, so repeated query only rebinds values
+     */
+    class StatementCache
+    {
+        public:
+            explicit StatementCache(const std::size_t capacity = default_capacity());
+            StatementCache(const StatementCache&) = delete;
+            StatementCache& operator=(const StatementCache&) = delete;
+
+            Poco::Data::Statement& prepare(Poco::Data::Session &session, const QueryShape &shape);
+            void invalidate();
+            std::size_t size() const { return _entries.size(); }
+            std::size_t capacity() const { return _capacity; }
+
+            static void invalidate_all();
+            static std::size_t default_capacity() { return _default_capacity; }
+            static void set_default_capacity(const std::size_t capacity);
+        private:
+            /// Prepared statement bound to its own copy of the parameters
+            struct Entry {
+                Entry(Poco::Data::Session &session, const std::string &key) : key(key), statement(session) {}
+                std::string key;
+                Poco::Data::Statement statement;
+                Params params;
+            };
+            typedef std::list<Entry> Entries;
+
+            Entries _entries; /// Most recently used at the front
+            std::unordered_map<std::string, Entries::iterator> _index;
+            std::size_t _capacity;
+            unsigned long _generation;
+
+            static std::atomic<unsigned long> _global_generation; /// Bumped when schema changes
+            static std::atomic<std::size_t> _default_capacity;
+    };
+}
+#endif // STATEMENTCACHE_H
@@ -0,0 +1,255 @@
+#ifndef STATICQUERY_H
+#define STATICQUERY_H
+
+#include <string>
+#include <vector>
+#include <tuple>
+#include <memory>
+#include <type_traits>
+#include <boost/preprocessor/repetition/enum.hpp>
+#include "Poco/Data/Common.h"
+#include "Poco/Data/RecordSet.h"
+#include "SessionPool.h"
+#include "StatementCache.h"
+#include "QueryMetrics.h"
+#include "SlowQueryLog.h"
+
+/// Max length of the string used by DB_STATIC_STRING
+#define DB_STATIC_STRING_MAX 64
+#define DB_STATIC_CHAR(z, n, S) DB::detail::char_at(S, n)
+/// String literal as type (DB::detail::String<'a', 'b', ...>), usable as template argument
+#define DB_STATIC_STRING(S) DB::detail::MakeString<sizeof(S), BOOST_PP_ENUM(DB_STATIC_STRING_MAX, DB_STATIC_CHAR, S)>::type
+
+/**
+ * Tags describing the schema, i.e.:
+ * DB_STATIC_TABLE(Accounts, "Accounts");
+ * DB_STATIC_COLUMN(AccountId, Accounts, "id", Poco::Int64);
+ * Column type is used for both bound values and results, it has to be convertible by Poco::DynamicAny
+ */
+#define DB_STATIC_TABLE(TAG, NAME) \
+    struct TAG { typedef DB_STATIC_STRING(NAME) name; }
+#define DB_STATIC_COLUMN(TAG, TABLE, NAME, TYPE) \
+    struct TAG { typedef TABLE table; typedef DB_STATIC_STRING(NAME) name; typedef TYPE type; }
+
+namespace DB
+{
+    namespace detail
+    {
+        /// Characters of the string as template parameters, value is a compile-time constant
+        template <char... Cs>
+        struct String {
+            static const char value[sizeof...(Cs) + 1];
+        };
+        template <char... Cs>
+        const char String<Cs...>::value[sizeof...(Cs) + 1] = {Cs..., '\0'};
+
+        template <std::size_t N>
+        constexpr char char_at(const char (&text)[N], const std::size_t pos)
+        {
+            return pos < N ? text[pos] : '\0';
+        }
+
+        /// Dropping padding after the terminating zero
+        template <typename Res, char... Cs>
+        struct Trim;
+        template <char... Rs>
+        struct Trim<String<Rs...>> { typedef String<Rs...> type; };
+        template <char... Rs, char... Cs>
+        struct Trim<String<Rs...>, '\0', Cs...> { typedef String<Rs...> type; };
+        template <char... Rs, char C, char... Cs>
+        struct Trim<String<Rs...>, C, Cs...> : Trim<String<Rs..., C>, Cs...> {};
+
+        template <std::size_t N, char... Cs>
+        struct MakeString : Trim<String<>, Cs...> {
+            static_assert(N <= DB_STATIC_STRING_MAX, "String is too long for DB_STATIC_STRING");
+        };
+
+        template <typename... Ss>
+        struct Concat { typedef String<> type; };
+        template <char... As>
+        struct Concat<String<As...>> { typedef String<As...> type; };
+        template <char... As, char... Bs, typename... Rest>
+        struct Concat<String<As...>, String<Bs...>, Rest...> : Concat<String<As..., Bs...>, Rest...> {};
+
+        /// Strings separated by Sep
+        template <typename Sep, typename... Ss>
+        struct Joined { typedef String<> type; };
+        template <typename Sep, typename S>
+        struct Joined<Sep, S> { typedef S type; };
+        template <typename Sep, typename S, typename Next, typename... Rest>
+        struct Joined<Sep, S, Next, Rest...> {
+            typedef typename Concat<S, Sep, typename Joined<Sep, Next, Rest...>::type>::type type;
+        };
+
+        template <typename T, typename... Ts>
+        struct Contains : std::false_type {};
+        template <typename T, typename... Ts>
+        struct Contains<T, T, Ts...> : std::true_type {};
+        template <typename T, typename U, typename... Ts>
+        struct Contains<T, U, Ts...> : Contains<T, Ts...> {};
+
+        template <bool... Bs>
+        struct All : std::true_type {};
+        template <bool B, bool... Bs>
+        struct All<B, Bs...> : std::integral_constant<bool, B and All<Bs...>::value> {};
+
+        template <std::size_t... I>
+        struct Indices {};
+        template <std::size_t N, std::size_t... I>
+        struct BuildIndices : BuildIndices<N - 1, N - 1, I...> {};
+        template <std::size_t... I>
+        struct BuildIndices<0, I...> { typedef Indices<I...> type; };
+
+        /// `table`.`column`
+        template <typename Column>
+        struct Qualified {
+            typedef typename Concat<String<'`'>, typename Column::table::name, String<'`', '.', '`'>,
+                typename Column::name, String<'`'>>::type type;
+        };
+
+        /// Values converted to column types first, so only values of matching types compile
+        template <typename Arguments, std::size_t... I, typename... Args>
+        Params static_params(Indices<I...>, const Args&... args)
+        {
+            return Params{Param(typename std::tuple_element<I, Arguments>::type(args))...};
+        }
+
+        template <typename Row, std::size_t... I>
+        Row static_row(const Poco::Data::RecordSet &rs, const std::size_t row, Indices<I...>)
+        {
+            return Row(rs.value(I, row).template convert<typename std::tuple_element<I, Row>::type>()...);
+        }
+    }
+
+    /// Columns read by the query
+    template <typename... Columns>
+    struct Cols {
+        typedef std::tuple<typename Columns::type...> Row;
+        typedef typename detail::Joined<detail::String<',', ' '>, typename detail::Qualified<Columns>::type...>::type sql;
+    };
+
+    /// Condition comparing column with bound value
+    template <typename Column, typename Op, typename Value = typename Column::type>
+    struct Condition {
+        typedef Column column;
+        typedef Value param_type;
+        typedef typename detail::Concat<typename detail::Qualified<Column>::type, Op>::type sql;
+    };
+    template <typename Column> using Eq = Condition<Column, DB_STATIC_STRING(" = ?")>;
+    template <typename Column> using Ne = Condition<Column, DB_STATIC_STRING(" <> ?")>;
+    template <typename Column> using Lt = Condition<Column, DB_STATIC_STRING(" < ?")>;
+    template <typename Column> using Le = Condition<Column, DB_STATIC_STRING(" <= ?")>;
+    template <typename Column> using Gt = Condition<Column, DB_STATIC_STRING(" > ?")>;
+    template <typename Column> using Ge = Condition<Column, DB_STATIC_STRING(" >= ?")>;
+    template <typename Column> using Like = Condition<Column, DB_STATIC_STRING(" LIKE ?"), std::string>;
+
+    /// Conditions joined with AND, each one has its own placeholder
+    template <typename... Conditions>
+    struct Where {
+        typedef std::tuple<typename Conditions::param_type...> Arguments;
+        typedef typename detail::Concat<DB_STATIC_STRING(" WHERE "),
+            typename detail::Joined<DB_STATIC_STRING(" AND "), typename Conditions::sql...>::type>::type sql;
+    };
+    template <>
+    struct Where<> {
+        typedef std::tuple<> Arguments;
+        typedef detail::String<> sql;
+    };
+
+    /// Joining table on equal columns
+    template <typename Table, typename Column1, typename Column2, typename Keyword = DB_STATIC_STRING(" JOIN `")>
+    struct StaticJoin {
+        typedef Table table;
+        typedef Column1 column1;
+        typedef Column2 column2;
+        typedef typename detail::Concat<Keyword, typename Table::name, DB_STATIC_STRING("` ON "),
+            typename detail::Qualified<Column1>::type, DB_STATIC_STRING(" = "), typename detail::Qualified<Column2>::type>::type sql;
+    };
+    template <typename Table, typename Column1, typename Column2>
+    using LeftJoin = StaticJoin<Table, Column1, Column2, DB_STATIC_STRING(" LEFT OUTER JOIN `")>;
+
+    namespace detail
+    {
+        template <typename Column, typename Tables>
+        struct InTables;
+        template <typename Column, typename... Tables>
+        struct InTables<Column, std::tuple<Tables...>> : Contains<typename Column::table, Tables...> {};
+
+        /// Do all columns (of Cols, Where or joins) belong to the tables?
+        template <typename Tables, typename List>
+        struct AllInTables;
+        template <typename Tables, typename... Columns>
+        struct AllInTables<Tables, Cols<Columns...>> : All<InTables<Columns, Tables>::value...> {};
+        template <typename Tables, typename... Conditions>
+        struct AllInTables<Tables, Where<Conditions...>> : All<InTables<typename Conditions::column, Tables>::value...> {};
+        template <typename Tables, typename... Joins>
+        struct AllInTables<Tables, std::tuple<Joins...>>
+            : All<(InTables<typename Joins::column1, Tables>::value and InTables<typename Joins::column2, Tables>::value)...> {};
+    }
+
+    /**
+     * Executing queries of StaticSelect, common for all of them
+     */
+    class StaticQuery
+    {
+        public:
+            static std::unique_ptr<Poco::Data::RecordSet> execute(Connection &connection, const QueryShape &shape, QueryTrace &trace);
+    };
+
+    /**
+     * Query with structure fixed at compile time: SQL text is a constant and values/rows are typed
+     * Columns which don't belong to the queried tables and wrong number or types of values fail the build.
+     * Usage:
+     *   typedef StaticSelect<Accounts, Cols<AccountId, AccountName>, Where<Eq<AccountId>>> AccountById;
+     *   for(const auto &row : AccountById::get("main.db", 5)) ...
+     */
+    template <typename Table, typename Columns, typename Conditions = Where<>, typename... Joins>
+    class StaticSelect
+    {
+        typedef std::tuple<Table, typename Joins::table...> Tables;
+        static_assert(detail::AllInTables<Tables, Columns>::value, "Column doesn't belong to the queried tables");
+        static_assert(detail::AllInTables<Tables, Conditions>::value, "Condition uses column which doesn't belong to the queried tables");
+        static_assert(detail::AllInTables<Tables, std::tuple<Joins...>>::value, "Join uses column which doesn't belong to the queried tables");
+        public:
+            typedef typename Columns::Row Row;
+            typedef typename Conditions::Arguments Arguments;
+            typedef typename detail::Concat<DB_STATIC_STRING("SELECT "), typename Columns::sql, DB_STATIC_STRING(" FROM `"),
+                typename Table::name, detail::String<'`'>, typename Joins::sql..., typename Conditions::sql, detail::String<';'>>::type Sql;
+
+            static constexpr const char* sql() { return Sql::value; }
+
+            /**
+             * Executing query, statement is prepared once per session
+             *
+             * @param  Connection connection database session
+             * @param  Args args values of placeholders, in order of conditions
+             * @return rows of the result
+             */
+            template <typename... Args>
+            static std::vector<Row> get(Connection &connection, const Args&... args)
+            {
+                static_assert(sizeof...(Args) == std::tuple_size<Arguments>::value, "Number of values doesn't match the query");
+                const QueryShape shape = {sql(), detail::static_params<Arguments>(typename detail::BuildIndices<sizeof...(Args)>::type(), args...)};
+                QueryTrace trace(shape.text);
+                const auto rs = StaticQuery::execute(connection, shape, trace);
+                std::vector<Row> res;
+                res.reserve(rs->rowCount());
+                for(std::size_t row = 0; row < rs->rowCount(); ++row)
+                    res.push_back(detail::static_row<Row>(*rs, row, typename detail::BuildIndices<std::tuple_size<Row>::value>::type()));
+                trace.mark(STAGE::CONVERT);
+                trace.finish(res.size(), res.size() * sizeof(Row));
+                SlowQueryLog::check(connection, shape, trace, res.size());
+
+                return res;
+            }
+
+            /// Executing query on session borrowed from the pool of the database
+            template <typename... Args>
+            static std::vector<Row> get(const std::string &db_name, const Args&... args)
+            {
+                auto connection = SessionPool::get(db_name)->acquire();
+                return get(*connection, args...);
+            }
+    };
+}
+#endif // STATICQUERY_H
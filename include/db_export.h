@@ -0,0 +1,447 @@
+#ifndef DB_EXPORT_H_INCLUDED
+#define DB_EXPORT_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <typeinfo>
+#include <unistd.h>
+#include "Poco/Exception.h"
+#include "Poco/Data/DataException.h"
+#include "db_filters.h"
+
+/// Formats written by export_rows()
+enum class EXPORT { CSV, JSON_LINES, COLUMNAR };
+
+/**
+ * Destination of the export: stream or file descriptor, written through one large reusable buffer
+ */
+class ExportSink {
+    public:
+        static const std::size_t DEFAULT_CAPACITY = 1 << 20;
+
+        explicit ExportSink(std::ostream &out, const std::size_t capacity = DEFAULT_CAPACITY)
+            : _out(&out), _capacity(capacity) { _buffer.reserve(capacity + capacity / 8); }
+        explicit ExportSink(const int fd, const std::size_t capacity = DEFAULT_CAPACITY)
+            : _fd(fd), _capacity(capacity) { _buffer.reserve(capacity + capacity / 8); }
+        ExportSink(const ExportSink&) = delete;
+        ExportSink& operator=(const ExportSink&) = delete;
+        /// Errors of the last write are lost here, call flush() to see them
+        ~ExportSink() { try { flush(); } catch(...) {} }
+
+        /// Buffer the output is appended to, written out by commit() once it's full
+        std::string& buffer() { return _buffer; }
+        void commit() { if(_buffer.size() >= _capacity) flush(); }
+        void write(const boost::string_ref text) { _buffer.append(text.data(), text.size()); }
+        void put(const char c) { _buffer += c; }
+        /// Bytes written to the destination so far
+        unsigned long long written() const { return _written; }
+
+        void flush()
+        {
+            if(_buffer.empty())
+                return;
+            if(_out != nullptr)
+            {
+                _out->write(_buffer.data(), static_cast<std::streamsize>(_buffer.size()));
+                if( ! *_out)
+                    throw Poco::IOException("Writing export stream failed");
+            }
+            else
+            {
+                std::size_t done = 0;
+                while(done < _buffer.size())
+                {
+                    const auto res = ::write(_fd, _buffer.data() + done, _buffer.size() - done);
+                    if(res < 0 and errno == EINTR)
+                        continue;
+                    if(res < 0)
+                        throw Poco::IOException("Writing export file failed", std::strerror(errno));
+                    done += static_cast<std::size_t>(res);
+                }
+            }
+            _written += _buffer.size();
+            _buffer.clear();
+        }
+    private:
+        std::ostream *_out = nullptr;
+        int _fd = -1;
+        std::size_t _capacity;
+        std::string _buffer;
+        unsigned long long _written = 0;
+};
+
+/**
+ * Building blocks of export_rows()
+ */
+namespace exporters
+{
+    /**
+     * Values of one result column in the current chunk, reused for all chunks
+     */
+    struct ChunkColumn {
+        std::string name;
+        const FilterCols *filter = nullptr;
+        DB::ColumnVector::TYPE type = DB::ColumnVector::TYPE::TEXT; /// Type of the output (filtered columns are text)
+        bool typed = false; /// Type is fixed by the first chunk
+        std::vector<char> nulls;
+        std::vector<char> mismatched; /// Value doesn't fit the type of the column, it's kept only as text
+        std::vector<Poco::Int64> ints; /// INTEGER values, for the columnar format
+        std::vector<double> reals; /// REAL values, for the columnar format
+        FilterArena text; /// Values as text
+        FilterArena filtered; /// Output of the filter
+        ColumnView view;
+
+        const FilterArena& out() const { return filter != nullptr ? filtered : text; }
+    };
+
+    /// Storage used for the result column
+    inline DB::ColumnVector::TYPE column_type(const Poco::Data::RecordSet &rs, const std::size_t col)
+    {
+        using namespace Poco::Data;
+
+        switch(rs.columnType(col))
+        {
+            case MetaColumn::FDT_BOOL: case MetaColumn::FDT_INT8: case MetaColumn::FDT_UINT8:
+            case MetaColumn::FDT_INT16: case MetaColumn::FDT_UINT16: case MetaColumn::FDT_INT32:
+            case MetaColumn::FDT_UINT32: case MetaColumn::FDT_INT64: case MetaColumn::FDT_UINT64:
+                return DB::ColumnVector::TYPE::INTEGER;
+            case MetaColumn::FDT_FLOAT: case MetaColumn::FDT_DOUBLE:
+                return DB::ColumnVector::TYPE::REAL;
+            default:
+                return DB::ColumnVector::TYPE::TEXT;
+        }
+    }
+
+    /**
+     * Storage fitting all values of the column in the first chunk
+     * SQLite types values, not columns, so declared INTEGER column may hold reals or text too
+     *
+     * @param  Poco::Data::RecordSet rs first chunk of the cursor
+     * @param  std::size_t col_id column index
+     * @return DB::ColumnVector::TYPE type of the column in the whole output
+     */
+    inline DB::ColumnVector::TYPE first_chunk_type(const Poco::Data::RecordSet &rs, const std::size_t col_id)
+    {
+        auto res = column_type(rs, col_id);
+        for(std::size_t row = 0; row < rs.rowCount() and res != DB::ColumnVector::TYPE::TEXT; ++row)
+        {
+            const auto val = rs.value(col_id, row);
+            if(val.isEmpty() or val.isInteger())
+                continue;
+            res = val.isNumeric() ? DB::ColumnVector::TYPE::REAL : DB::ColumnVector::TYPE::TEXT;
+        }
+
+        return res;
+    }
+
+    /**
+     * Reading column of the chunk and filtering it
+     * Type of the column is fixed by the first chunk, so the columnar header is valid for all chunks.
+     * Values of later chunks which don't fit the type are kept as text (mismatched).
+     *
+     * @param Poco::Data::RecordSet rs current chunk of the cursor
+     * @param std::size_t col_id column index
+     * @param ChunkColumn col receives values
+     */
+    inline void fill(const Poco::Data::RecordSet &rs, const std::size_t col_id, ChunkColumn &col)
+    {
+        const auto rows = rs.rowCount();
+        if( ! col.typed)
+        {
+            col.type = col.filter != nullptr ? DB::ColumnVector::TYPE::TEXT : first_chunk_type(rs, col_id);
+            col.typed = true;
+        }
+        // Filtered columns are read as the values are, only their output is text
+        const auto source = col.filter != nullptr ? column_type(rs, col_id) : col.type;
+        col.nulls.clear();
+        col.mismatched.clear();
+        col.ints.clear();
+        col.reals.clear();
+        col.text.clear();
+        col.text.reserve(rows, rows * 8);
+        for(std::size_t row = 0; row < rows; ++row)
+        {
+            const auto val = rs.value(col_id, row);
+            const bool fits = val.isEmpty() or (source == DB::ColumnVector::TYPE::INTEGER ? val.isInteger()
+                : source == DB::ColumnVector::TYPE::REAL ? val.isNumeric() : true);
+            col.nulls.push_back(val.isEmpty());
+            col.mismatched.push_back( ! fits and col.filter == nullptr);
+            if(val.isEmpty() or ! fits)
+            {
+                col.ints.push_back(0);
+                col.reals.push_back(0.0);
+            }
+            if(val.isEmpty())
+                col.text.commit();
+            else if(source == DB::ColumnVector::TYPE::INTEGER and fits)
+            {
+                const auto num = val.convert<Poco::Int64>();
+                col.ints.push_back(num);
+                filters::append_int(col.text.buffer(), num);
+                col.text.commit();
+            }
+            else if(source == DB::ColumnVector::TYPE::REAL and fits)
+            {
+                const auto num = val.convert<double>();
+                char buf[32];
+                const auto written = std::snprintf(buf, sizeof(buf), "%.15g", num);
+                col.reals.push_back(num);
+                col.text.append(boost::string_ref(buf, written > 0 ? std::min<std::size_t>(written, sizeof(buf) - 1) : 0));
+            }
+            // Text is already stored as std::string, so it's not converted again
+            else if(val.type() == typeid(std::string))
+                col.text.append(val.extract<std::string>());
+            else
+                col.text.append(val.convert<std::string>());
+        }
+        if(col.filter == nullptr)
+            return;
+        col.view.clear();
+        for(std::size_t row = 0; row < rows; ++row)
+            col.view.push_back(col.text[row]);
+        col.filter->apply(col.view, col.filtered);
+    }
+
+    /// CSV field, quoted only if needed
+    inline void write_csv(std::string &out, const boost::string_ref val)
+    {
+        if(val.find_first_of(",\"\r\n") == boost::string_ref::npos)
+        {
+            out.append(val.data(), val.size());
+            return;
+        }
+        out += '"';
+        for(const char c : val)
+        {
+            if(c == '"')
+                out += '"';
+            out += c;
+        }
+        out += '"';
+    }
+
+    /// JSON string, with quotes
+    inline void write_json(std::string &out, const boost::string_ref val)
+    {
+        static const char hex[] = "0123456789abcdef";
+        out += '"';
+        std::size_t plain = 0;
+        for(std::size_t i = 0; i < val.size(); ++i)
+        {
+            const auto c = static_cast<unsigned char>(val[i]);
+            if(c >= 0x20 and c != '"' and c != '\\')
+                continue;
+            out.append(val.data() + plain, i - plain);
+            plain = i + 1;
+            if(c == '"' or c == '\\')
+                (out += '\\') += static_cast<char>(c);
+            else if(c == '\n')
+                out.append("\\n");
+            else if(c == '\t')
+                out.append("\\t");
+            else
+                (out.append("\\u00") += hex[c >> 4]) += hex[c & 0xF];
+        }
+        out.append(val.data() + plain, val.size() - plain);
+        out += '"';
+    }
+
+    /// Raw bytes of the value, in host byte order
+    template <typename T>
+    inline void write_binary(ExportSink &sink, const T &val)
+    {
+        sink.buffer().append(reinterpret_cast<const char*>(&val), sizeof(T));
+    }
+
+    inline void write_csv_rows(ExportSink &sink, const std::vector<ChunkColumn> &cols, const std::size_t rows)
+    {
+        for(std::size_t row = 0; row < rows; ++row)
+        {
+            for(std::size_t i = 0; i < cols.size(); ++i)
+            {
+                if(i != 0)
+                    sink.put(',');
+                write_csv(sink.buffer(), cols[i].out()[row]);
+            }
+            sink.put('\n');
+            sink.commit();
+        }
+    }
+
+    /**
+     * One JSON object per line, keys (with quotes and colon) are rendered once in keys
+     * Numbers and NULLs of not filtered columns are written as JSON numbers and null
+     */
+    inline void write_json_rows(ExportSink &sink, const std::vector<ChunkColumn> &cols, const std::vector<std::string> &keys, const std::size_t rows)
+    {
+        for(std::size_t row = 0; row < rows; ++row)
+        {
+            for(std::size_t i = 0; i < cols.size(); ++i)
+            {
+                const auto &col = cols[i];
+                sink.write(keys[i]);
+                if(col.nulls[row] and col.filter == nullptr)
+                    sink.write("null");
+                else if(col.mismatched[row])
+                    write_json(sink.buffer(), col.out()[row]);
+                else if(col.type == DB::ColumnVector::TYPE::INTEGER
+                        or (col.type == DB::ColumnVector::TYPE::REAL and std::isfinite(col.reals[row])))
+                    sink.write(col.text[row]);
+                else if(col.type == DB::ColumnVector::TYPE::REAL)
+                    sink.write("null");
+                else
+                    write_json(sink.buffer(), col.out()[row]);
+            }
+            sink.write("}\n");
+            sink.commit();
+        }
+    }
+
+    /// Header of the columnar format: magic, number of columns, type and name of each
+    inline void write_columnar_header(ExportSink &sink, const std::vector<ChunkColumn> &cols)
+    {
+        sink.write(boost::string_ref("DBCOLS01", 8));
+        write_binary(sink, static_cast<std::uint32_t>(cols.size()));
+        for(const auto &col : cols)
+        {
+            write_binary(sink, static_cast<std::uint8_t>(col.type));
+            write_binary(sink, static_cast<std::uint32_t>(col.name.size()));
+            sink.write(col.name);
+        }
+    }
+
+    /// Columnar batch: number of rows and for each column null bitmap and values
+    inline void write_columnar_batch(ExportSink &sink, const std::vector<ChunkColumn> &cols, const std::size_t rows)
+    {
+        // Type is already in the header, value which doesn't fit it can't be written without loss
+        for(const auto &col : cols)
+            for(std::size_t row = 0; row < rows; ++row)
+                if(col.mismatched[row])
+                    throw Poco::Data::DataException("Value doesn't fit type of column " + col.name + " fixed by the first chunk: "
+                        + col.text[row].to_string() + " (cast the column to TEXT)");
+        write_binary(sink, static_cast<std::uint32_t>(rows));
+        for(const auto &col : cols)
+        {
+            auto &out = sink.buffer();
+            const auto bitmap = out.size();
+            out.append((rows + 7) / 8, '\0');
+            for(std::size_t row = 0; row < rows; ++row)
+                if(col.nulls[row])
+                    out[bitmap + row / 8] |= static_cast<char>(1 << (row % 8));
+            if(col.type == DB::ColumnVector::TYPE::INTEGER)
+                out.append(reinterpret_cast<const char*>(col.ints.data()), rows * sizeof(Poco::Int64));
+            else if(col.type == DB::ColumnVector::TYPE::REAL)
+                out.append(reinterpret_cast<const char*>(col.reals.data()), rows * sizeof(double));
+            else
+            {
+                const auto &values = col.out();
+                std::uint32_t offset = 0;
+                write_binary(sink, offset);
+                for(std::size_t row = 0; row < rows; ++row)
+                    write_binary(sink, offset += static_cast<std::uint32_t>(values[row].size()));
+                for(std::size_t row = 0; row < rows; ++row)
+                    sink.write(values[row]);
+            }
+            sink.commit();
+        }
+    }
+}
+
+/**
+ * Writing rows of the cursor to the sink, chunk by chunk
+ * Values are read column by column from the cursor's chunk into reusable buffers,
+ * filtered by the batch filters of FilterCols and written without building DB::Row for any row.
+ *
+ * Columnar format (host byte order):
+ *   header: "DBCOLS01", u32 columns, for each column u8 type (0 - integer, 1 - real, 2 - text), u32 name length, name
+ *   batch:  u32 rows, for each column null bitmap ((rows + 7) / 8 bytes, bit set - NULL) and
+ *           rows x i64 (integer) | rows x f64 (real) | (rows + 1) x u32 offsets and bytes of values (text)
+ *   end:    u32 0
+ * Types are fixed by the first chunk (a column mixing types there is text), filtered columns are text.
+ * Values of later chunks which don't fit the type are written as text in CSV and JSON, columnar export fails
+ * with Poco::Data::DataException on them (such column can be cast to TEXT in the query).
+ *
+ * @param  DB::Cursor cursor cursor before the first row
+ * @param  ExportSink sink destination, flushed at the end
+ * @param  EXPORT format output format
+ * @param  std::vector<FilterCols> filter_cols filters of columns (matched by the result column name)
+ * @param  bool header write column names first (CSV)
+ * @return unsigned long long number of written rows
+ */
+inline unsigned long long export_rows(DB::Cursor &cursor, ExportSink &sink, const EXPORT format,
+    const std::vector<FilterCols> &filter_cols = std::vector<FilterCols>(), const bool header = true)
+{
+    using namespace exporters;
+
+    std::vector<ChunkColumn> cols(cursor.cols().size());
+    std::vector<std::string> keys;
+    for(std::size_t i = 0; i < cols.size(); ++i)
+    {
+        cols[i].name = cursor.cols()[i];
+        for(const auto &filter : filter_cols)
+            if(filter.column() == cols[i].name)
+                cols[i].filter = &filter;
+        if(format == EXPORT::JSON_LINES)
+        {
+            keys.push_back(i != 0 ? "," : "{");
+            write_json(keys.back(), cols[i].name);
+            keys.back() += ':';
+        }
+    }
+    if(format == EXPORT::CSV and header)
+    {
+        for(std::size_t i = 0; i < cols.size(); ++i)
+        {
+            if(i != 0)
+                sink.put(',');
+            write_csv(sink.buffer(), cols[i].name);
+        }
+        sink.put('\n');
+    }
+
+    unsigned long long rows = 0;
+    while(cursor.next_chunk())
+    {
+        const auto &rs = cursor.chunk();
+        for(std::size_t i = 0; i < cols.size(); ++i)
+            fill(rs, i, cols[i]);
+        if(format == EXPORT::COLUMNAR and rows == 0)
+            write_columnar_header(sink, cols);
+        if(format == EXPORT::CSV)
+            write_csv_rows(sink, cols, rs.rowCount());
+        else if(format == EXPORT::JSON_LINES)
+            write_json_rows(sink, cols, keys, rs.rowCount());
+        else
+            write_columnar_batch(sink, cols, rs.rowCount());
+        rows += rs.rowCount();
+    }
+    if(format == EXPORT::COLUMNAR)
+    {
+        if(rows == 0)
+            write_columnar_header(sink, cols);
+        write_binary(sink, static_cast<std::uint32_t>(0));
+    }
+    sink.flush();
+
+    return rows;
+}
+
+/**
+ * Writing result of the query to the sink
+ * @see export_rows(DB::Cursor&, ...)
+ *
+ * @param  DB::Select select query (i.e. with columns(conv(filter_cols)))
+ * @param  std::size_t chunk_size rows read from the statement at once
+ */
+inline unsigned long long export_rows(DB::Select &select, ExportSink &sink, const EXPORT format,
+    const std::vector<FilterCols> &filter_cols = std::vector<FilterCols>(), const bool header = true, const std::size_t chunk_size = 10000)
+{
+    return export_rows(*select.cursor(chunk_size), sink, format, filter_cols, header);
+}
+
+#endif // DB_EXPORT_H_INCLUDED
@@ -4,65 +4,590 @@
 #include <functional>
 #include <string>
 #include <vector>
-#include <boost/format.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <algorithm>
+#include <boost/function.hpp>
+#include <boost/utility/string_ref.hpp>
+#include "DBReflectionHelper.h"
+
+/// Values of one column, pointing into the result (not owning them)
+typedef std::vector<boost::string_ref> ColumnView;
+
+/**
+ * Reusable output of the column filter, all values are kept in one buffer
+ * Cleared before every column, so after the first rows memory is not allocated anymore
+ */
+class FilterArena {
+    public:
+        void clear() { _data.clear(); _offsets.assign(1, 0); }
+        void reserve(const std::size_t rows, const std::size_t bytes) { _offsets.reserve(rows + 1); _data.reserve(bytes); }
+        std::size_t size() const { return _offsets.size() - 1; }
+        boost::string_ref operator[](const std::size_t row) const
+        {
+            return boost::string_ref(_data.data() + _offsets[row], _offsets[row + 1] - _offsets[row]);
+        }
+        /// Buffer the value is appended to, finished with commit()
+        std::string& buffer() { return _data; }
+        void commit() { _offsets.push_back(_data.size()); }
+        void append(const boost::string_ref val) { _data.append(val.data(), val.size()); commit(); }
+    private:
+        std::string _data;
+        std::vector<std::size_t> _offsets = std::vector<std::size_t>(1, 0);
+};
 
 /**
  * Klasa przechowująca nazwę pola, nazwę wyświetlaną i filtr
+ * Optional batch filter formats whole column at once, without allocating memory per cell
  */
 class FilterCols {
     public:
         typedef boost::function<std::string(const std::string&)> Filter;
-        FilterCols(const std::string &name, const std::string &verbose, Filter filter)
-            : name(name), verbose(verbose), filter(filter) {}
+        typedef boost::function<void(const ColumnView&, FilterArena&)> BatchFilter;
+        FilterCols(const std::string &name, const std::string &verbose, Filter filter, BatchFilter batch = BatchFilter())
+            : name(name), verbose(verbose), filter(filter), batch(batch) {}
+
+        /// Name of the result column (alias, if it is set)
+        const std::string& column() const { return verbose != "" ? verbose : name; }
+        void apply(const ColumnView &values, FilterArena &out) const
+        {
+            out.clear();
+            if( ! batch.empty())
+            {
+                batch(values, out);
+                return;
+            }
+            for(const auto &val : values)
+                out.append(filter(std::string(val.begin(), val.end())));
+        }
 
         std::string name;
         std::string verbose;
         Filter filter;
+        BatchFilter batch;
 };
 
 /**
  * Konwersja aby pozbyć się ostatniej kolumny (filtra)
  */
-std::vector<DB::Column> conv(const std::vector<FilterCols> &cols)
+inline std::vector<DB::Column> conv(const std::vector<FilterCols> &cols)
 {
     std::vector<DB::Column> res;
-    for(auto c : cols)
+    for(const auto &c : cols)
         res.push_back(DB::Column(c.name, c.verbose));
     return res;
 }
 
+/// Units of file sizes
+constexpr unsigned KILO = 1024;
+constexpr auto convs = {"B", "KB", "MB", "GB", "TB"};
+
+/**
+ * Allocation-free building blocks of the filters, writing into the given buffer
+ */
+namespace filters
+{
+    /// Leading integer of the value (like std::stoll), false if there are no digits
+    inline bool parse_int(const boost::string_ref val, long long &res)
+    {
+        std::size_t pos = 0;
+        const bool negative = ! val.empty() and val[0] == '-';
+        if( ! val.empty() and (val[0] == '-' or val[0] == '+'))
+            ++pos;
+        const auto start = pos;
+        res = 0;
+        for(; pos < val.size() and val[pos] >= '0' and val[pos] <= '9'; ++pos)
+            res = res * 10 + (val[pos] - '0');
+        if(negative)
+            res = -res;
+        return pos != start;
+    }
+
+    /// Decimal digits of the number, at least width of them (padded with zeros)
+    inline void append_uint(std::string &out, unsigned long long val, const unsigned width = 1)
+    {
+        char buf[20];
+        unsigned len = 0;
+        do {
+            buf[len++] = static_cast<char>('0' + val % 10);
+            val /= 10;
+        } while(val != 0);
+        for(; len < width; ++len)
+            buf[len] = '0';
+        while(len != 0)
+            out += buf[--len];
+    }
+
+    inline void append_int(std::string &out, const long long val)
+    {
+        if(val < 0)
+            out += '-';
+        append_uint(out, val < 0 ? 0ULL - static_cast<unsigned long long>(val) : static_cast<unsigned long long>(val));
+    }
+
+    /// Leave unchanged
+    struct raw_field {
+        void operator()(const boost::string_ref val, std::string &out) const
+        {
+            if(val.empty())
+                out += '-';
+            else
+                out.append(val.data(), val.size());
+        }
+    };
+
+    /// RRRRMMDD date to DD-MM-RRRR
+    struct birthday {
+        void operator()(const boost::string_ref val, std::string &out) const
+        {
+            if(val.size() != 8)
+            {
+                out += "nieznana";
+                return;
+            }
+            out.append(val.data() + 6, 2) += '-';
+            out.append(val.data() + 4, 2) += '-';
+            out.append(val.data(), 4);
+        }
+    };
+
+    /// Days since 1970-01-01 to date (proleptic Gregorian calendar)
+    struct CivilDate {
+        long long year;
+        unsigned month; /// 1-12
+        unsigned day; /// 1-31
+        unsigned weekday; /// 0 - Sunday
+    };
+
+    inline CivilDate civil_from_days(long long days)
+    {
+        CivilDate res;
+        res.weekday = static_cast<unsigned>(days >= -4 ? (days + 4) % 7 : (days + 5) % 7 + 6);
+        days += 719468;
+        const long long era = (days >= 0 ? days : days - 146096) / 146097;
+        const auto doe = static_cast<unsigned>(days - era * 146097);
+        const auto yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        const auto doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        const auto mp = (5 * doy + 2) / 153;
+        res.day = doy - (153 * mp + 2) / 5 + 1;
+        res.month = mp < 10 ? mp + 3 : mp - 9;
+        res.year = static_cast<long long>(yoe) + era * 400 + (res.month <= 2 ? 1 : 0);
+        return res;
+    }
+
+    /// Date of the day, recently used days of the thread are cached, so rows from the same day skip calendar math
+    inline const CivilDate& cached_date(const long long days)
+    {
+        struct Entry {
+            bool valid;
+            long long days;
+            CivilDate date;
+        };
+        static thread_local Entry cache[16] = {};
+        auto &entry = cache[static_cast<unsigned long long>(days) % 16];
+        if( ! entry.valid or entry.days != days)
+        {
+            entry.valid = true;
+            entry.days = days;
+            entry.date = civil_from_days(days);
+        }
+        return entry.date;
+    }
+
+    /// Two digits of the number 0-99
+    inline void write_2digits(char *&pos, const unsigned val)
+    {
+        static const char digits[] =
+            "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+            "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+            "8081828384858687888990919293949596979899";
+        *pos++ = digits[2 * val];
+        *pos++ = digits[2 * val + 1];
+    }
+
+    /// Decimal digits of the number, at least width of them (padded with zeros)
+    inline void write_uint(char *&pos, unsigned long long val, const unsigned width = 1)
+    {
+        char buf[20];
+        unsigned len = 0;
+        do {
+            buf[len++] = static_cast<char>('0' + val % 10);
+            val /= 10;
+        } while(val != 0);
+        for(; len < width; ++len)
+            buf[len] = '0';
+        while(len != 0)
+            *pos++ = buf[--len];
+    }
+
+    /**
+     * Date format compiled once, supports specifiers of Poco::DateTimeFormatter:
+     * %w %W %b %B %d %e %f %m %n %o %y %Y %H %h %a %A %M %S %%
+     * Dates are in UTC
+     */
+    class TimestampFormat {
+        public:
+            explicit TimestampFormat(const std::string &format)
+            {
+                for(std::size_t i = 0; i < format.size(); ++i)
+                {
+                    if(format[i] != '%' or i + 1 == format.size())
+                    {
+                        _literal(format[i]);
+                        continue;
+                    }
+                    const char spec = format[++i];
+                    const std::string specs = "wWbBdefmnoyYHhaAMS";
+                    if(specs.find(spec) == std::string::npos)
+                    {
+                        _literal(spec);
+                        continue;
+                    }
+                    _parts.push_back(Part{spec, 0, 0});
+                    _max_size += spec == 'Y' ? 20 : (spec == 'W' or spec == 'B' ? 9 : 3);
+                }
+            }
+
+            /// Buffer size enough for any date
+            std::size_t max_size() const { return _max_size; }
+
+            /**
+             * Format the date into buffer of at least max_size() bytes
+             *
+             * @param  long long seconds UNIX timestamp
+             * @param  char* buf output buffer
+             * @return std::size_t length of the date
+             */
+            std::size_t format(const long long seconds, char *buf) const
+            {
+                static const char *weekdays[] = {"Sunday", "Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday"};
+                static const char *months[] = {"January", "February", "March", "April", "May", "June", "July",
+                    "August", "September", "October", "November", "December"};
+
+                const long long days = seconds >= 0 ? seconds / 86400 : -((-seconds + 86399) / 86400);
+                const auto time = static_cast<unsigned>(seconds - days * 86400);
+                const auto hour = time / 3600;
+                const CivilDate &date = cached_date(days);
+                char *pos = buf;
+                for(const auto &part : _parts)
+                {
+                    switch(part.spec)
+                    {
+                        case '\0': pos = std::copy(_text.data() + part.begin, _text.data() + part.end, pos); break;
+                        case 'w': pos = std::copy(weekdays[date.weekday], weekdays[date.weekday] + 3, pos); break;
+                        case 'W': pos = std::copy(weekdays[date.weekday], weekdays[date.weekday] + std::strlen(weekdays[date.weekday]), pos); break;
+                        case 'b': pos = std::copy(months[date.month - 1], months[date.month - 1] + 3, pos); break;
+                        case 'B': pos = std::copy(months[date.month - 1], months[date.month - 1] + std::strlen(months[date.month - 1]), pos); break;
+                        case 'd': write_2digits(pos, date.day); break;
+                        case 'e': write_uint(pos, date.day); break;
+                        case 'f':
+                            if(date.day < 10)
+                                *pos++ = ' ';
+                            write_uint(pos, date.day);
+                            break;
+                        case 'm': write_2digits(pos, date.month); break;
+                        case 'n': write_uint(pos, date.month); break;
+                        case 'o':
+                            if(date.month < 10)
+                                *pos++ = ' ';
+                            write_uint(pos, date.month);
+                            break;
+                        case 'y': write_2digits(pos, static_cast<unsigned>(((date.year % 100) + 100) % 100)); break;
+                        case 'Y':
+                            if(date.year < 0)
+                                *pos++ = '-';
+                            write_uint(pos, static_cast<unsigned long long>(date.year < 0 ? -date.year : date.year), 4);
+                            break;
+                        case 'H': write_2digits(pos, hour); break;
+                        case 'h': write_2digits(pos, hour % 12 == 0 ? 12 : hour % 12); break;
+                        case 'a': *pos++ = hour < 12 ? 'a' : 'p'; *pos++ = 'm'; break;
+                        case 'A': *pos++ = hour < 12 ? 'A' : 'P'; *pos++ = 'M'; break;
+                        case 'M': write_2digits(pos, time % 3600 / 60); break;
+                        case 'S': write_2digits(pos, time % 60); break;
+                    }
+                }
+                return static_cast<std::size_t>(pos - buf);
+            }
+
+            /// Format the date at the end of the buffer (memory is allocated only if its capacity is too small)
+            void format(const long long seconds, std::string &out) const
+            {
+                const auto start = out.size();
+                out.resize(start + _max_size);
+                out.resize(start + format(seconds, &out[start]));
+            }
+        private:
+            /// Literal text (spec 0, range of _text) or date field
+            struct Part {
+                char spec;
+                std::size_t begin;
+                std::size_t end;
+            };
+
+            void _literal(const char c)
+            {
+                if(_parts.empty() or _parts.back().spec != '\0')
+                    _parts.push_back(Part{'\0', _text.size(), _text.size()});
+                _text += c;
+                ++_parts.back().end;
+                ++_max_size;
+            }
+
+            std::vector<Part> _parts;
+            std::string _text; /// Literal parts of the format
+            std::size_t _max_size = 0;
+    };
+
+    /// Convert from UNIX timestamp (multiplied by given factor) to date, by default in format %H:%M:%S %d/%n/%Y
+    struct timestamp {
+        explicit timestamp(const unsigned long long factor = 1, const std::string &format = "%H:%M:%S %d/%n/%Y")
+            : factor(factor), format(std::make_shared<const TimestampFormat>(format)) {}
+        void operator()(const boost::string_ref val, std::string &out) const
+        {
+            long long seconds = 0;
+            if(val.empty() or val == "0")
+            {
+                out += "nieznany";
+                return;
+            }
+            if( ! parse_int(val, seconds))
+            {
+                out += "#err";
+                return;
+            }
+            format->format(seconds * static_cast<long long>(factor), out);
+        }
+
+        unsigned long long factor;
+        std::shared_ptr<const TimestampFormat> format; /// Shared by copies of the filter
+    };
+
+    /// Amount of time formatted as Xh Ymin Zs instead of just seconds
+    struct time {
+        void operator()(const boost::string_ref val, std::string &out) const
+        {
+            long long total = 0;
+            if(val.empty())
+            {
+                out += '0';
+                return;
+            }
+            if( ! parse_int(val, total))
+            {
+                out += "#err";
+                return;
+            }
+            const auto h = total / 3600, m = (total % 3600) / 60, s = total % 60;
+            if(h != 0)
+            {
+                append_int(out, h);
+                out += "h ";
+            }
+            if(m != 0)
+            {
+                append_int(out, m);
+                out += "min ";
+            }
+            if(s != 0)
+            {
+                append_int(out, s);
+                out += 's';
+            }
+        }
+    };
+
+    /// Timezone in format GMT +/-X
+    struct timezone {
+        void operator()(const boost::string_ref val, std::string &out) const
+        {
+            long long tz = 0;
+            if(val.empty())
+                out += '-';
+            else if(val == "93600")
+                out += "czas komputera";
+            else if(val == "86400" or val == "0")
+                out += "GMT";
+            else if( ! parse_int(val, tz))
+                out += "#err";
+            else
+            {
+                out += tz < 86400 ? "GMT -" : "GMT +";
+                append_int(out, tz < 86400 ? (86400 - tz) / 3600 : (tz - 86400) / 3600);
+            }
+        }
+    };
+
+    /// Size of the file in human readable format
+    struct filesize {
+        void operator()(const boost::string_ref val, std::string &out) const
+        {
+            // strtod needs terminated string, sizes are short
+            char num[64];
+            const auto len = std::min(val.size(), sizeof(num) - 1);
+            std::copy(val.begin(), val.begin() + len, num);
+            num[len] = '\0';
+            auto size = std::strtod(num, nullptr);
+            std::size_t i = 0;
+            for(; size > KILO and i + 1 < convs.size(); ++i)
+                size /= KILO;
+            // Values beyond the largest unit may not fit, snprintf returns length of the whole value then
+            char buf[32];
+            const auto written = std::snprintf(buf, sizeof(buf), "%.2f", size);
+            out.append(buf, written > 0 ? std::min<std::size_t>(written, sizeof(buf) - 1) : 0) += *(convs.begin() + i);
+        }
+    };
+}
+
+/**
+ * Column filter applying cell formatter to every value, without type erasure per cell
+ */
+template <typename Cell>
+FilterCols::BatchFilter batch_filter(const Cell &cell)
+{
+    return [cell](const ColumnView &values, FilterArena &out) {
+        for(const auto &val : values)
+        {
+            cell(val, out.buffer());
+            out.commit();
+        }
+    };
+}
+
+/**
+ * Values of the column of the result
+ *
+ * @param DB::Data data result of the query
+ * @param std::string column name of the result column
+ * @param ColumnView view receives values, valid as long as data is not changed
+ */
+inline void column_view(const DB::Data &data, const std::string &column, ColumnView &view)
+{
+    view.clear();
+    view.reserve(data.size());
+    for(const auto &row : data)
+    {
+        const auto it = row.find(column);
+        view.push_back(it != row.end() ? boost::string_ref(it->second) : boost::string_ref());
+    }
+}
+
+/**
+ * Values of the typed column as text, numbers are written into scratch buffer
+ *
+ * @param DB::ColumnVector column column of the result
+ * @param std::string scratch receives text of numbers, reused between columns
+ * @param ColumnView view receives values, valid as long as column and scratch are not changed
+ */
+inline void column_view(const DB::ColumnVector &column, std::string &scratch, ColumnView &view)
+{
+    view.clear();
+    view.reserve(column.size());
+    if(column.type() == DB::ColumnVector::TYPE::TEXT)
+    {
+        for(std::size_t row = 0; row < column.size(); ++row)
+            view.push_back(column.is_null(row) ? boost::string_ref() : column.get_text(row));
+        return;
+    }
+    // Offsets first, scratch may be reallocated while it's filled
+    std::vector<std::size_t> offsets(1, 0);
+    offsets.reserve(column.size() + 1);
+    scratch.clear();
+    for(std::size_t row = 0; row < column.size(); ++row)
+    {
+        if(column.is_null(row))
+            ;
+        else if(column.type() == DB::ColumnVector::TYPE::INTEGER)
+            filters::append_int(scratch, column.get_int(row));
+        else
+        {
+            char buf[32];
+            const auto written = std::snprintf(buf, sizeof(buf), "%.15g", column.get_real(row));
+            scratch.append(buf, written > 0 ? std::min<std::size_t>(written, sizeof(buf) - 1) : 0);
+        }
+        offsets.push_back(scratch.size());
+    }
+    for(std::size_t row = 0; row < column.size(); ++row)
+        view.push_back(boost::string_ref(scratch.data() + offsets[row], offsets[row + 1] - offsets[row]));
+}
+
+/**
+ * Filtering the result column by column, out[i] receives values of cols[i]
+ *
+ * @param std::vector<FilterCols> cols filtered columns
+ * @param DB::Data data result of the query
+ * @param std::vector<FilterArena> out outputs, reused between calls
+ */
+inline void apply_filters(const std::vector<FilterCols> &cols, const DB::Data &data, std::vector<FilterArena> &out)
+{
+    ColumnView view;
+    out.resize(cols.size());
+    for(std::size_t i = 0; i < cols.size(); ++i)
+    {
+        column_view(data, cols[i].column(), view);
+        cols[i].apply(view, out[i]);
+    }
+}
+
+/**
+ * Filtering the result column by column, out[i] receives values of cols[i]
+ *
+ * @param std::vector<FilterCols> cols filtered columns
+ * @param DB::ColumnarData data result of the query
+ * @param std::vector<FilterArena> out outputs, reused between calls
+ */
+inline void apply_filters(const std::vector<FilterCols> &cols, const DB::ColumnarData &data, std::vector<FilterArena> &out)
+{
+    ColumnView view;
+    std::string scratch;
+    out.resize(cols.size());
+    for(std::size_t i = 0; i < cols.size(); ++i)
+    {
+        column_view(data.column(cols[i].column()), scratch, view);
+        cols[i].apply(view, out[i]);
+    }
+}
+
 #define COLLAMBDA [](const std::string &val)
 
 /**
  * Some basic lambdas for use in more than one place
+ * Hot ones use filters:: formatters, pass batch_filter(filters::...()) to FilterCols to format whole columns
  */
 /// Leave unchanged
-auto raw_field_ = COLLAMBDA{ return val != "" ? val : "-"; };
+const auto raw_field_ = COLLAMBDA{ return val != "" ? val : "-"; };
 
 /// RRRRMMDD date to DD-MM-RRRR
-auto birthday_ = COLLAMBDA{
-    return (val.length() != 8) ? "nieznana" : (val.substr(6) + "-" + val.substr(4,2) + "-" + val.substr(0,4));
+const auto birthday_ = COLLAMBDA{
+    std::string res;
+    filters::birthday()(val, res);
+    return res;
 };
 
 /// User's gender
-auto gender_ = COLLAMBDA{
+const auto gender_ = COLLAMBDA{
     return val == "1" ? "mężczyzna" : (val == "2" ? "kobieta" : "nieokreślona");
 };
 
 /// Convert from UNIX timestamp to normal date
-auto timestamp_ = COLLAMBDA{
-    if(val == "" or val == "0") return std::string("nieznany");
-    return Poco::DateTimeFormatter::format(Poco::Timestamp(std::stoull(val) * 1000000), "%H:%M:%S %d/%n/%Y");
+const auto timestamp_ = COLLAMBDA{
+    static const filters::timestamp format;
+    std::string res;
+    format(val, res);
+    return res;
 };
 
 /// Convert specific UNIX timestamp to date (i.e. timestamp /60 to date)
-auto spec_timestamp_ = COLLAMBDA{
-    if(val == "" or val == "0") return std::string("nieznany");
-    return timestamp_(std::to_string(std::stoull(val) * 60));
+const auto spec_timestamp_ = COLLAMBDA{
+    static const filters::timestamp format(60);
+    std::string res;
+    format(val, res);
+    return res;
 };
 
 /// Account status
-auto acc_status_ = COLLAMBDA{
+const auto acc_status_ = COLLAMBDA{
     if(val == "") return "0";
     switch(std::stoi(val)) {
         case 1: return "niepodłączony";
@@ -75,31 +600,24 @@ auto acc_status_ = COLLAMBDA{
 };
 
 /// Amount of time formatted as Xh Ymin Zs instead of just seconds
-auto time_ = COLLAMBDA{
-    if(val == "") return std::string("0");
-    const auto h = std::stoi(val) / 3600, m = (std::stoi(val) % 3600) / 60, s = std::stoi(val) % 60;
-    return (h != 0 ? std::to_string(h)+"h " : "") + (m != 0 ? std::to_string(m)+"min " : "") + (s != 0 ? std::to_string(s)+"s" : "");
+const auto time_ = COLLAMBDA{
+    std::string res;
+    filters::time()(val, res);
+    return res;
 };
 
 /// Timezone in format GMT +/-X
-auto timezone_ = COLLAMBDA{
-    if(val == "") return std::string("-");
-    else if(val == "93600") return std::string("czas komputera");
-    else if(val == "86400" or val == "0") return std::string("GMT");
-    auto tmp = std::stoi(val);
-    return "GMT " +
-        ( tmp < 86400 ? ("-" + std::to_string((86400 - tmp) / 3600)) : ("+" + std::to_string((tmp - 86400) / 3600)) );
+const auto timezone_ = COLLAMBDA{
+    std::string res;
+    filters::timezone()(val, res);
+    return res;
 };
 
 /// Size of the file in human readable format
-constexpr unsigned KILO = 1024;
-constexpr auto convs = {"B", "KB", "MB", "GB", "TB"};
-auto filesize_ = COLLAMBDA{
-    auto vald = std::stod(val);
-    int i;
-    for(i = 0; vald > KILO; ++i)
-        vald /= KILO;
-    return str(boost::format("%.2f") % vald) + *(convs.begin() + i);
+const auto filesize_ = COLLAMBDA{
+    std::string res;
+    filters::filesize()(val, res);
+    return res;
 };
 
 #endif // DB_FILTERS_H_INCLUDED
@@ -0,0 +1,148 @@
+#include "AsyncExecutor.h"
+#include <cassert>
+#include <algorithm>
+#include <iostream>
+
+namespace DB
+{
+    /**
+     * Starting worker threads
+     *
+     * @param std::size_t workers number of threads
+     * @param std::size_t queue_size max number of waiting queries
+     */
+    AsyncExecutor::AsyncExecutor(const std::size_t workers, const std::size_t queue_size)
+        : _queue_size(queue_size)
+    {
+        assert(workers > 0 and queue_size > 0);
+        for(std::size_t i = 0; i < workers; ++i)
+            _workers.emplace_back(&AsyncExecutor::_work, this);
+    }
+
+    /**
+     * Finishing queued queries and stopping workers
+     */
+    AsyncExecutor::~AsyncExecutor()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _not_empty.notify_all();
+        for(auto &worker : _workers)
+            worker.join();
+    }
+
+    /**
+     * Executor shared by Select::async_get(), one worker per CPU core (at least 4)
+     *
+     * @return AsyncExecutor default executor
+     */
+    AsyncExecutor& AsyncExecutor::instance()
+    {
+        static AsyncExecutor executor(std::max(4u, std::thread::hardware_concurrency()), 256);
+        return executor;
+    }
+
+    /**
+     * Queue query for execution
+     *
+     * @param  std::string db_name name of database
+     * @param  CompiledQuery query query to execute
+     * @return std::future<Data> result of the query
+     */
+    std::future<AsyncExecutor::Data> AsyncExecutor::submit(const std::string &db_name, const CompiledQuery &query)
+    {
+        // Queued query must not keep session of its Select borrowed
+        const auto task_query = query.detached();
+        return execute(db_name, [task_query](Connection &connection) { return task_query.get(connection); });
+    }
+
+    /**
+     * Queue query for execution, result is passed to the callback (called on worker thread)
+     * Exceptions thrown by the callback are written to stderr, worker goes on with the next task.
+     * Callback must not submit another query when the queue may be full: it would wait for a worker,
+     * while it blocks one itself (the only one, if the executor has a single worker).
+     *
+     * @param std::string db_name name of database
+     * @param CompiledQuery query query to execute
+     * @param Callback callback result consumer
+     */
+    void AsyncExecutor::submit(const std::string &db_name, const CompiledQuery &query, const Callback &callback)
+    {
+        const auto task_query = query.detached();
+        _push(Task{db_name, [task_query, callback](const SessionProvider &session) {
+            Data res;
+            std::exception_ptr error;
+            try {
+                res = task_query.get(session.acquire());
+            }
+            catch(...) {
+                error = std::current_exception();
+            }
+            session.release();
+            // Exception leaving the task would terminate the worker thread, and the whole process with it
+            try {
+                callback(res, error);
+            }
+            catch(const std::exception &e) {
+                std::cerr << "[async callback] " << e.what() << std::endl;
+            }
+            catch(...) {
+                std::cerr << "[async callback] unknown exception" << std::endl;
+            }
+        }});
+    }
+
+    /**
+     * Number of queries waiting for a worker
+     *
+     * @return std::size_t queue length
+     */
+    std::size_t AsyncExecutor::pending() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _queue.size();
+    }
+
+    /**
+     * Put task into the queue, waiting while the queue is full
+     *
+     * @param Task task queued work
+     */
+    void AsyncExecutor::_push(Task &&task)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _not_full.wait(lock, [this] { return _queue.size() < _queue_size; });
+        _queue.push_back(std::move(task));
+        _not_empty.notify_one();
+    }
+
+    /**
+     * Worker loop, session is borrowed from the pool of the database for each task
+     */
+    void AsyncExecutor::_work()
+    {
+        for(;;)
+        {
+            Task task;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _not_empty.wait(lock, [this] { return _stopping or ! _queue.empty(); });
+                if(_queue.empty())
+                    return;
+                task = std::move(_queue.front());
+                _queue.pop_front();
+            }
+            _not_full.notify_one();
+
+            // Session is acquired inside the task, so errors (i.e. pool timeout) are reported through its future/callback
+            SessionPool::SessionPtr connection;
+            task.run(SessionProvider{[&connection, &task]() -> Connection& {
+                connection = SessionPool::get(task.db_name)->acquire();
+                return *connection;
+            }, [&connection]() { connection.reset(); }});
+            connection.reset();
+        }
+    }
+} // End namespace DB
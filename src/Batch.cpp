@@ -0,0 +1,71 @@
+#include "Batch.h"
+#include "DBReflectionHelper.h"
+#include <cassert>
+
+namespace DB
+{
+    /**
+     * Add query built by the Select
+     *
+     * @param  Select select query builder (must use the same database)
+     * @param  std::string table_name name of table
+     * @return Batch
+     */
+    Batch& Batch::add(Select &select, const std::string &table_name)
+    {
+        assert(select.db_name() == _db_name);
+        return add(select.compile(table_name));
+    }
+
+    /**
+     * Add compiled query
+     *
+     * @param  CompiledQuery query query to execute
+     * @return Batch
+     */
+    Batch& Batch::add(const CompiledQuery &query)
+    {
+        _queries.push_back(query.detached());
+        return (*this);
+    }
+
+    /**
+     * Execute all queries inside one transaction
+     * Whole batch counts as one query in QueryCounter
+     *
+     * @return std::vector<Data> results, in order of adding
+     */
+    std::vector<Batch::Data> Batch::get()
+    {
+        std::vector<Data> res;
+        res.reserve(_queries.size());
+        if(_queries.empty())
+            return res;
+
+        auto connection = SessionPool::get(_db_name)->acquire();
+        connection->session.begin();
+        try {
+            for(const auto &query : _queries)
+                res.push_back(query._fetch(*connection));
+            connection->session.commit();
+        }
+        catch(...) {
+            connection->session.rollback();
+            throw;
+        }
+        QueryCounter::inc();
+
+        return res;
+    }
+
+    /**
+     * Remove all queries
+     *
+     * @return Batch
+     */
+    Batch& Batch::clear()
+    {
+        _queries.clear();
+        return (*this);
+    }
+} // End namespace DB
@@ -0,0 +1,273 @@
+#include "ColumnarData.h"
+#include <cassert>
+#include <sstream>
+#include <iomanip>
+#include <cstdlib>
+#include <cerrno>
+#include <cmath>
+#include "Poco/Exception.h"
+
+namespace DB
+{
+    namespace
+    {
+        /// Whole text is an integer
+        bool parse_int(const std::string &text, Poco::Int64 &val)
+        {
+            char *end = nullptr;
+            errno = 0;
+            val = std::strtoll(text.c_str(), &end, 10);
+            return ! text.empty() and *end == '\0' and errno == 0;
+        }
+
+        /// Whole text is a number
+        bool parse_real(const std::string &text, double &val)
+        {
+            char *end = nullptr;
+            val = std::strtod(text.c_str(), &end);
+            return ! text.empty() and *end == '\0';
+        }
+    }
+
+    /**
+     * Reading value of INTEGER column (REAL values are truncated)
+     *
+     * @param  std::size_t row row number
+     * @return value, 0 for NULL or text which doesn't start with a number
+     */
+    Poco::Int64 ColumnVector::get_int(const std::size_t row) const
+    {
+        if(_type == TYPE::INTEGER)
+            return _ints[row];
+        if(_type == TYPE::REAL)
+            return static_cast<Poco::Int64>(_reals[row]);
+        const auto text = get_text(row);
+        return std::strtoll(std::string(text.begin(), text.end()).c_str(), nullptr, 10);
+    }
+
+    /**
+     * Reading value of REAL column
+     *
+     * @param  std::size_t row row number
+     * @return value, 0.0 for NULL or text which doesn't start with a number
+     */
+    double ColumnVector::get_real(const std::size_t row) const
+    {
+        if(_type == TYPE::REAL)
+            return _reals[row];
+        if(_type == TYPE::INTEGER)
+            return static_cast<double>(_ints[row]);
+        const auto text = get_text(row);
+        return std::strtod(std::string(text.begin(), text.end()).c_str(), nullptr);
+    }
+
+    /**
+     * Reading value of TEXT column without copying it
+     *
+     * @param  std::size_t row row number
+     * @return view of the text, valid as long as the column, empty for NULL
+     */
+    boost::string_ref ColumnVector::get_text(const std::size_t row) const
+    {
+        assert(_type == TYPE::TEXT);
+        return boost::string_ref(_arena.data() + _offsets[row], _offsets[row + 1] - _offsets[row]);
+    }
+
+    /**
+     * Value converted to string, the same way as in DB::Row
+     *
+     * @param  std::size_t row row number
+     * @return value as text, empty for NULL
+     */
+    std::string ColumnVector::to_string(const std::size_t row) const
+    {
+        if(_nulls[row])
+            return std::string();
+        switch(_type)
+        {
+            case TYPE::INTEGER: return std::to_string(_ints[row]);
+            case TYPE::REAL:
+            {
+                std::ostringstream out;
+                out << std::setprecision(15) << _reals[row];
+                return out.str();
+            }
+            case TYPE::TEXT:
+            {
+                const auto text = get_text(row);
+                return std::string(text.begin(), text.end());
+            }
+        }
+
+        return std::string();
+    }
+
+    /**
+     * Number of bytes allocated by the column
+     *
+     * @return std::size_t allocated memory
+     */
+    std::size_t ColumnVector::memory_usage() const
+    {
+        return _ints.capacity() * sizeof(Poco::Int64) + _reals.capacity() * sizeof(double) + _arena.capacity()
+            + _offsets.capacity() * sizeof(std::size_t) + _nulls.capacity() / 8;
+    }
+
+    void ColumnVector::_reserve(const std::size_t rows)
+    {
+        _nulls.reserve(rows);
+        if(_type == TYPE::INTEGER)
+            _ints.reserve(rows);
+        else if(_type == TYPE::REAL)
+            _reals.reserve(rows);
+        else
+            _offsets.reserve(rows + 1);
+    }
+
+    void ColumnVector::_push_int(const Poco::Int64 val)
+    {
+        if(_type == TYPE::INTEGER)
+            _ints.push_back(val);
+        else if(_type == TYPE::REAL)
+            _reals.push_back(static_cast<double>(val));
+        else
+        {
+            const auto text = std::to_string(val);
+            _push_text(text.data(), text.size());
+            return;
+        }
+        _nulls.push_back(false);
+    }
+
+    void ColumnVector::_push_real(const double val)
+    {
+        if(_type == TYPE::INTEGER and (val != std::trunc(val) or std::fabs(val) >= 9.2e18))
+            _to_text();
+        if(_type == TYPE::REAL)
+            _reals.push_back(val);
+        else if(_type == TYPE::INTEGER)
+            _ints.push_back(static_cast<Poco::Int64>(val));
+        else
+        {
+            std::ostringstream out;
+            out << std::setprecision(15) << val;
+            const auto text = out.str();
+            _push_text(text.data(), text.size());
+            return;
+        }
+        _nulls.push_back(false);
+    }
+
+    void ColumnVector::_push_text(const char *val, const std::size_t len)
+    {
+        if(_type != TYPE::TEXT)
+        {
+            const std::string text(val, len);
+            Poco::Int64 int_val = 0;
+            double real_val = 0.0;
+            if(_type == TYPE::INTEGER and parse_int(text, int_val))
+                return _push_int(int_val);
+            if(_type == TYPE::REAL and parse_real(text, real_val))
+                return _push_real(real_val);
+            // SQLite keeps text which doesn't look like a number as it is, even in numeric columns
+            _to_text();
+        }
+        _arena.append(val, len);
+        _offsets.push_back(_arena.size());
+        _nulls.push_back(false);
+    }
+
+    void ColumnVector::_push_null()
+    {
+        if(_type == TYPE::INTEGER)
+            _ints.push_back(0);
+        else if(_type == TYPE::REAL)
+            _reals.push_back(0.0);
+        else
+            _offsets.push_back(_arena.size());
+        _nulls.push_back(true);
+    }
+
+    /**
+     * Changing storage of the column to TEXT, values already stored are converted
+     */
+    void ColumnVector::_to_text()
+    {
+        if(_type == TYPE::TEXT)
+            return;
+        const auto type = _type;
+        std::vector<Poco::Int64> ints;
+        std::vector<double> reals;
+        std::vector<bool> nulls;
+        ints.swap(_ints);
+        reals.swap(_reals);
+        nulls.swap(_nulls);
+        _type = TYPE::TEXT;
+        _offsets.reserve(nulls.capacity() + 1);
+        for(std::size_t row = 0; row < nulls.size(); ++row)
+        {
+            if(nulls[row])
+                _push_null();
+            else if(type == TYPE::INTEGER)
+                _push_int(ints[row]);
+            else
+                _push_real(reals[row]);
+        }
+    }
+
+    /**
+     * Creating empty result with known columns
+     *
+     * @param std::vector<std::string> names names of the columns
+     * @param std::vector<ColumnVector::TYPE> types storage used for each column
+     */
+    ColumnarData::ColumnarData(const std::vector<std::string> &names, const std::vector<ColumnVector::TYPE> &types)
+        : _names(names)
+    {
+        assert(names.size() == types.size());
+        _columns.reserve(types.size());
+        for(const auto type : types)
+            _columns.emplace_back(type);
+    }
+
+    /**
+     * Position of the column with given name
+     *
+     * @param  std::string name name (or alias) of the column
+     * @return std::size_t column index
+     */
+    std::size_t ColumnarData::index(const std::string &name) const
+    {
+        for(std::size_t i = 0; i < _names.size(); ++i)
+            if(_names[i] == name)
+                return i;
+        throw Poco::NotFoundException("No such column", name);
+    }
+
+    /**
+     * Reserve space for given number of rows in every column
+     *
+     * @param std::size_t rows expected number of rows
+     */
+    void ColumnarData::reserve(const std::size_t rows)
+    {
+        for(auto &col : _columns)
+            col._reserve(rows);
+    }
+
+    /**
+     * Number of bytes allocated by all columns
+     *
+     * @return std::size_t allocated memory
+     */
+    std::size_t ColumnarData::memory_usage() const
+    {
+        std::size_t res = 0;
+        for(const auto &col : _columns)
+            res += col.memory_usage();
+        for(const auto &name : _names)
+            res += name.capacity();
+
+        return res;
+    }
+} // End namespace DB
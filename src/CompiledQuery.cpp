@@ -0,0 +1,147 @@
+#include "CompiledQuery.h"
+#include "DBReflectionHelper.h"
+#include "QueryMetrics.h"
+#include "SlowQueryLog.h"
+#include <cassert>
+
+namespace DB
+{
+    /**
+     * Change value of the placeholder before next execution
+     *
+     * @param  std::size_t pos position of the placeholder (from 0, literals of the query count too)
+     * @param  Param value new value
+     * @return CompiledQuery
+     */
+    CompiledQuery& CompiledQuery::bind(const std::size_t pos, const Param &value)
+    {
+        assert(pos < _shape.params.size());
+        _shape.params[pos] = value;
+        return (*this);
+    }
+
+    /**
+     * Copy of the query which doesn't keep session of the Select borrowed
+     * Detached query can be executed only with explicitly given session
+     *
+     * @return CompiledQuery query without session
+     */
+    CompiledQuery CompiledQuery::detached() const
+    {
+        return CompiledQuery(SessionPool::SessionPtr(), _shape, _cols);
+    }
+
+    /**
+     * Executing query on the session of Select which compiled it
+     *
+     * @return Data read from table
+     */
+    CompiledQuery::Data CompiledQuery::get() const
+    {
+        assert(_connection);
+        return get(*_connection);
+    }
+
+    /**
+     * Executing query on given session (i.e. owned by worker thread)
+     *
+     * @param  Connection connection database session
+     * @return Data read from table
+     */
+    CompiledQuery::Data CompiledQuery::get(Connection &connection) const
+    {
+        auto res = _fetch(connection);
+        QueryCounter::inc();
+
+        return res;
+    }
+
+    /**
+     * Executing query on given session, values of some columns are also kept with their storage class
+     * (i.e. to tell NULLs from empty text and numbers from text, which are all strings in Data)
+     *
+     * @param  Connection connection database session
+     * @param  std::vector<std::size_t> typed_cols positions of the columns
+     * @param  Params typed receives values of the columns, row by row (index: row * typed_cols.size() + i), NULL as Param()
+     * @return Data read from table
+     */
+    CompiledQuery::Data CompiledQuery::get(Connection &connection, const std::vector<std::size_t> &typed_cols, Params &typed) const
+    {
+        auto res = _fetch(connection, typed_cols, &typed);
+        QueryCounter::inc();
+
+        return res;
+    }
+
+    /**
+     * Executing query and reading all rows
+     *
+     * @param  Connection connection database session
+     * @param  std::vector<std::size_t> typed_cols positions of the columns read also as typed values
+     * @param  Params typed receives typed values (optional)
+     * @return Data read from table
+     */
+    CompiledQuery::Data CompiledQuery::_fetch(Connection &connection, const std::vector<std::size_t> &typed_cols, Params *typed) const
+    {
+        using namespace Poco::Data;
+
+        QueryTrace trace(_shape.text);
+        Statement &select = connection.statements.prepare(connection.session, _shape);
+        trace.mark(STAGE::PREPARE);
+        select.execute();
+        trace.mark(STAGE::EXECUTE);
+        RecordSet rs(select);
+        trace.mark(STAGE::FETCH);
+        Data res;
+        res.reserve(rs.rowCount());
+        if(typed)
+        {
+            typed->clear();
+            typed->reserve(rs.rowCount() * typed_cols.size());
+        }
+        unsigned long long bytes = 0;
+        bool more = rs.moveFirst();
+        while(more)
+        {
+            Row tmp;
+            for(std::size_t col_id = 0; col_id < _cols.size(); ++col_id)
+            {
+                auto &val = tmp[_cols[col_id]];
+                const auto &field = rs[col_id];
+                val = field.convert<std::string>();
+                bytes += val.size();
+            }
+            if(typed)
+                for(const auto col_id : typed_cols)
+                    typed->push_back(_typed(rs[col_id], rs.columnType(col_id) == MetaColumn::FDT_BLOB));
+            res.push_back(std::move(tmp));
+            more = rs.moveNext();
+        }
+        trace.mark(STAGE::CONVERT);
+        trace.finish(res.size(), bytes);
+        SlowQueryLog::check(connection, _shape, trace, res.size());
+
+        return res;
+    }
+
+    /**
+     * Value of the result with its storage class
+     *
+     * @param  Poco::DynamicAny field value read from the result
+     * @param  bool blob value is read from BLOB column
+     * @return Param typed value, Param() for NULL
+     */
+    Param CompiledQuery::_typed(const Poco::DynamicAny &field, const bool blob)
+    {
+        if(field.isEmpty())
+            return Param();
+        if(blob)
+            return Param(Poco::Data::BLOB(field.convert<std::string>()));
+        if(field.isInteger())
+            return Param(field.convert<Poco::Int64>());
+        if(field.isNumeric())
+            return Param(field.convert<double>());
+
+        return Param(field.convert<std::string>());
+    }
+} // End namespace DB
@@ -0,0 +1,88 @@
+#include "Cursor.h"
+#include <cassert>
+
+namespace DB
+{
+    /**
+     * Preparing statement which reads the result chunk by chunk
+     *
+     * @param SessionPool::SessionPtr connection session used for reading
+     * @param QueryShape shape query with values of its placeholders
+     * @param ColsInfo cols names of the result columns
+     * @param std::size_t chunk_size number of rows fetched at once
+     */
+    Cursor::Cursor(const SessionPool::SessionPtr &connection, const QueryShape &shape, const ColsInfo &cols, const std::size_t chunk_size)
+        : _connection(connection), _params(shape.params), _statement(connection->session), _cols(cols)
+    {
+        using namespace Poco::Data;
+
+        assert(chunk_size > 0);
+        _statement << shape.text;
+        for(const auto &param : _params)
+            _statement, use(param);
+        _statement, limit(static_cast<Poco::UInt32>(chunk_size));
+    }
+
+    /**
+     * Move to the next row without converting it to Row
+     *
+     * @return false if there are no more rows
+     */
+    bool Cursor::next_raw()
+    {
+        if(_chunk and ++_chunk_row < _chunk->rowCount())
+            return true;
+
+        return _fetch();
+    }
+
+    /**
+     * Skip the rest of the current chunk and move to the first row of the next one
+     * For consumers processing whole chunks, i.e. column by column
+     *
+     * @return false if there are no more rows
+     */
+    bool Cursor::next_chunk()
+    {
+        return _fetch();
+    }
+
+    /**
+     * Move to the next row
+     *
+     * @return false if there are no more rows
+     */
+    bool Cursor::next()
+    {
+        if( ! next_raw())
+            return false;
+        for(std::size_t col_id = 0; col_id < _cols.size(); ++col_id)
+            _row[_cols[col_id]] = _chunk->value(col_id, _chunk_row).convert<std::string>();
+
+        return true;
+    }
+
+    /**
+     * Fetching next chunk of rows from the statement
+     *
+     * @return false if there are no more rows
+     */
+    bool Cursor::_fetch()
+    {
+        using namespace Poco::Data;
+
+        // Each execution steps the statement further, up to the chunk limit
+        while( ! _started or ! _statement.done())
+        {
+            _started = true;
+            _statement.execute();
+            _chunk.reset(new RecordSet(_statement));
+            _chunk_row = 0;
+            if(_chunk->rowCount() > 0)
+                return true;
+        }
+        _chunk.reset();
+
+        return false;
+    }
+} // End namespace DB
@@ -1,40 +1,56 @@
 #include "DBReflectionHelper.h"
+#include <queue>
+#include <iterator>
+#include <cstring>
+#include <cctype>
 
 namespace DB
 {
-    unsigned QueryCounter::_count;
-    bool Select::_is_registred = false;
+    std::atomic<unsigned> QueryCounter::_count(0);
+    std::atomic<unsigned long> StatementCounter::_hits(0);
+    std::atomic<unsigned long> StatementCounter::_misses(0);
 
     /**
      * Database connector shutdown
+     * Connector is registered only once per process, so no sessions can be opened afterwards
      */
     void shutdown()
     {
+        SessionPool::shutdown_all();
         Poco::Data::SQLite::Connector::unregisterConnector();
     }
 
+    namespace
+    {
+        inline StringType& append(StringType &out, const StringRef text)
+        {
+            return out.append(text.data(), text.size());
+        }
+    }
+
     /**
-     * Get string which can be used in the statement
+     * Rendering JOIN part of statement
      *
-     * @return StringType JOIN part of statement
+     * @param JOIN type type of join
+     * @param StringRef table joined table, tables of attached databases with the schema: archive.Users
+     * @param StringRef alias alias of the table (optional)
+     * @param StringRef col1 column compared in ON (not used in CROSS JOIN)
+     * @param StringRef col2 column compared in ON (not used in CROSS JOIN)
      */
-    StringType Join::get_string() const
+    Join::Join(const JOIN &type, const StringRef table, const StringRef alias, const StringRef col1, const StringRef col2)
     {
-        const auto TABLE = _alias != StringType() ? (_table + " AS `" + _alias + "`") : _table;
-        if(_type == JOIN::CROSS)
-            return "CROSS JOIN " + TABLE;
-        if(_type == JOIN::INNER)
-        {
-            assert(_col1 != StringType());
-            assert(_col2 != StringType());
-            return "JOIN " + TABLE + " ON " + _col1 + " = " + _col2;
-        }
-        else
-        {
-            assert(_col1 != StringType());
-            assert(_col2 != StringType());
-            return "LEFT OUTER JOIN " + TABLE + " ON " + _col1 + " = " + _col2;
-        }
+        assert( ! table.empty());
+        assert(type == JOIN::CROSS or ( ! col1.empty() and ! col2.empty()));
+        const StringRef keyword = type == JOIN::CROSS ? "CROSS JOIN " : (type == JOIN::INNER ? "JOIN " : "LEFT OUTER JOIN ");
+        _clause.reserve(keyword.size() + table.size() + alias.size() + col1.size() + col2.size() + 12);
+        append(_clause, keyword);
+        _table_begin = _clause.size();
+        _table_size = table.size();
+        append(_clause, table);
+        if( ! alias.empty())
+            append(_clause.append(" AS `"), alias) += '`';
+        if(type != JOIN::CROSS)
+            append(append(_clause.append(" ON "), col1).append(" = "), col2);
     }
 
     /**
@@ -49,6 +65,23 @@ namespace DB
         return Select(table_name, db_name);
     }
 
+    /**
+     * Run next queries on another database (i.e. replica chosen by Router), query stays as it is
+     * Session of the current database goes back to its pool
+     *
+     * @param  StringType db_name name of database
+     * @return Select
+     */
+    Select& Select::database(const StringType &db_name)
+    {
+        if(db_name == _db_name)
+            return (*this);
+        _ses = SessionPool::get(db_name)->acquire();
+        _db_name = db_name;
+
+        return (*this);
+    }
+
     /**
      * Reading list of columns in table
      *
@@ -57,27 +90,15 @@ namespace DB
      */
     ColsInfo Select::get_cols(StringType table_name)
     {
-        using namespace Poco::Data;
-
         if( ! _columns.empty())
             return _get_cols_for_userset();
 
-        assert((table_name != StringType() and _table_name != StringType()));
+        assert((table_name != StringType() or _table_name != StringType()));
         table_name = table_name != StringType() ? table_name : _table_name;
-        _cols_list.clear();
-        _cols_types.clear();
-        // Reading columns list
-        Statement cols(*_ses);
-        cols << StringType("PRAGMA TABLE_INFO(`") + table_name + StringType("`);");
-        cols.execute();
-        RecordSet rs(cols);
-        bool more = rs.moveFirst();
-        while(more)
-        {
-            _cols_list.push_back(rs[1].convert<StringType>());
-            _cols_types.push_back(rs[2].convert<StringType>());
-            more = rs.moveNext();
-        }
+        // Reading columns list, PRAGMA TABLE_INFO is run only if the table is not cached
+        const auto info = SchemaCache::get(*_ses, _db_name, table_name);
+        _cols_list = info.names;
+        _cols_types = info.types;
 
         return _cols_list;
     }
@@ -90,20 +111,94 @@ namespace DB
     ColsInfo Select::_get_cols_for_userset()
     {
         _cols_list.clear();
-        if(_columns.empty())
-            return _cols_list;
-        auto columns = _columns;
-        while( ! columns.empty())
+        for(const auto &col : _columns)
+            _cols_list.push_back(_text(col.second.size != 0 ? col.second : col.first).to_string());
+
+        return _cols_list;
+    }
+
+    /**
+     * Building the query with values of its placeholders
+     *
+     * @param  StringType table_name name of table
+     * @return QueryShape normalized query
+     */
+    QueryShape Select::_shape(StringType table_name)
+    {
+        QueryTrace trace;
+        return _shape(table_name, trace);
+    }
+
+    /**
+     * Building the query with values of its placeholders, measured as the build stage of the trace
+     *
+     * @param  StringType table_name name of table
+     * @param  QueryTrace trace started before building, receives shape of the query
+     * @return QueryShape normalized query
+     */
+    QueryShape Select::_shape(StringType table_name, QueryTrace &trace)
+    {
+        table_name = table_name != StringType() ? table_name : _table_name;
+        assert(table_name != StringType());
+        get_cols(table_name);
+        Params params;
+        const auto query = _construct_query(table_name, params);
+        auto res = normalize(query, params);
+        trace.shape(res.text);
+        trace.mark(STAGE::BUILD);
+
+        return res;
+    }
+
+    /**
+     * Open cursor reading the result in chunks
+     * Cursor keeps the session, so it can outlive this object
+     *
+     * @param  std::size_t chunk_size number of rows fetched at once
+     * @param  StringType table_name name of table
+     * @return cursor positioned before the first row
+     */
+    std::shared_ptr<Cursor> Select::cursor(const std::size_t chunk_size, StringType table_name)
+    {
+        auto res = std::make_shared<Cursor>(_ses, _shape(table_name), _cols_list, chunk_size);
+        QueryCounter::inc();
+
+        return res;
+    }
+
+    /**
+     * Rows of the result, read lazily: for(auto &row : select.rows()) { ... }
+     *
+     * @param  std::size_t chunk_size number of rows fetched at once
+     * @param  StringType table_name name of table
+     * @return RowRange range of rows
+     */
+    RowRange Select::rows(const std::size_t chunk_size, StringType table_name)
+    {
+        return RowRange(cursor(chunk_size, table_name));
+    }
+
+    /**
+     * Pass rows of the result to the callback, one at a time
+     * Reading stops when callback returns false, remaining rows are not fetched
+     *
+     * @param  std::function callback row consumer
+     * @param  std::size_t chunk_size number of rows fetched at once
+     * @param  StringType table_name name of table
+     * @return std::size_t number of rows passed to the callback
+     */
+    std::size_t Select::stream(const std::function<bool(const Row&)> &callback, const std::size_t chunk_size, StringType table_name)
+    {
+        auto rows = cursor(chunk_size, table_name);
+        std::size_t count = 0;
+        while(rows->next())
         {
-            const auto tmp = columns.front();
-            if(tmp.second != StringType())
-                _cols_list.push_back(tmp.second);
-            else
-                _cols_list.push_back(tmp.first);
-            columns.pop();
+            ++count;
+            if( ! callback(rows->row()))
+                break;
         }
 
-        return _cols_list;
+        return count;
     }
 
     /**
@@ -113,30 +208,418 @@ namespace DB
      * @return void
      */
     Data Select::get(StringType table_name)
+    {
+        const auto query = compile(table_name);
+        if(_cache_ttl.count() <= 0)
+        {
+            _table_data = query.get();
+            return _table_data;
+        }
+
+        // Tables read by the query, so the entry can be dropped when any of them changes
+        const auto cached = ResultCache::lookup(*_ses, _db_name, query);
+        if(cached)
+        {
+            _table_data = *cached;
+            return _table_data;
+        }
+        std::vector<StringType> tables(1, table_name != StringType() ? table_name : _table_name);
+        for(const auto &join : _joins)
+            tables.push_back(join.table().to_string());
+        _table_data = query.get();
+        ResultCache::store(_db_name, query, tables, _table_data, _cache_ttl);
+
+        return _table_data;
+    }
+
+    /**
+     * Keep results of get() in the shared result cache
+     * Use DB::invalidate(table) after modifying the table, or enable data_version checks in ResultCache::Config
+     *
+     * @param  std::chrono::milliseconds ttl time after which cached result expires, 0 - don't cache
+     * @return Select
+     */
+    Select& Select::cache(const std::chrono::milliseconds ttl)
+    {
+        _cache_ttl = ttl;
+        return (*this);
+    }
+
+    /**
+     * Getting data from table in the background, using shared executor
+     * Query is built on calling thread, so this object can be changed right after the call
+     *
+     * @param  StringType table_name name of table
+     * @return std::future<Data> data read from table
+     */
+    std::future<Data> Select::async_get(StringType table_name)
+    {
+        return async_get(AsyncExecutor::instance(), table_name);
+    }
+
+    /**
+     * Getting data from table in the background
+     *
+     * @param  AsyncExecutor executor worker pool executing the query
+     * @param  StringType table_name name of table
+     * @return std::future<Data> data read from table
+     */
+    std::future<Data> Select::async_get(AsyncExecutor &executor, StringType table_name)
+    {
+        return executor.submit(_db_name, compile(table_name));
+    }
+
+    /**
+     * Getting data from table in parallel, using shared executor
+     * @see Select::parallel_get(AsyncExecutor&, ...)
+     *
+     * @param  std::size_t shards number of key ranges
+     * @param  StringType key integer column used for splitting (rowid by default)
+     * @param  StringType table_name name of table
+     * @return Data data read from table
+     */
+    Data Select::parallel_get(const std::size_t shards, const StringType key, StringType table_name)
+    {
+        return parallel_get(AsyncExecutor::instance(), shards, key, table_name);
+    }
+
+    /**
+     * Getting data from table in parallel
+     * Range of the integer key is split into equal parts, every part is read by another worker, on its own session.
+     * Parts are concatenated in key order, or merged by order_by keys if sorting is set.
+     * Meant for scans of big tables: grouping, DISTINCT and OFFSET would be applied per part, so they are not allowed.
+     * Columns used in order_by have to be present in the result, they are merged with BINARY collation (no COLLATE).
+     * Key with values other than integers is rejected with Poco::InvalidArgumentException.
+     *
+     * @param  AsyncExecutor executor worker pool executing the parts
+     * @param  std::size_t shards number of key ranges
+     * @param  StringType key integer column used for splitting (rowid by default)
+     * @param  StringType table_name name of table
+     * @return Data data read from table
+     */
+    Data Select::parallel_get(AsyncExecutor &executor, const std::size_t shards, const StringType key, StringType table_name)
     {
         using namespace Poco::Data;
 
+        assert(shards > 0 and key != StringType());
+        assert(_group_by.empty() and ! _distinct and _offset.size == 0);
         table_name = table_name != StringType() ? table_name : _table_name;
-        assert(table_name != StringType());
-        get_cols(table_name);
-        Statement select(*_ses);
-        // Executing query
-        select << _construct_query(table_name);
+        const auto qualified_key = key == StringType("rowid") ? SchemaCache::quote(table_name) + ".rowid" : key;
+        // Bounds of the key, MIN/MAX are read from the index without scanning the table
+        Statement bounds(_ses->session);
+        bounds << "SELECT MIN(" + qualified_key + "), MAX(" + qualified_key + "), typeof(MIN(" + qualified_key + ")), typeof(MAX("
+            + qualified_key + ")) FROM " + SchemaCache::quote(table_name) + ";";
+        bounds.execute();
+        QueryCounter::inc();
+        RecordSet rs(bounds);
+        if(shards == 1 or ! rs.moveFirst() or rs[0].isEmpty())
+            return get(table_name);
+        // Text sorts after all numbers, so it would be MAX if there was any
+        if(rs[2].convert<StringType>() != "integer" or rs[3].convert<StringType>() != "integer")
+            throw Poco::InvalidArgumentException("Key of parallel_get() has to be integer: " + key);
+        const auto min = rs[0].convert<Poco::Int64>();
+        // Range is counted from min in unsigned arithmetic, so it doesn't overflow even for the whole Int64 range
+        const auto range = static_cast<Poco::UInt64>(rs[1].convert<Poco::Int64>()) - static_cast<Poco::UInt64>(min);
+        const auto step = range / shards + 1;
+        const auto key_at = [min](const Poco::UInt64 offset) { return static_cast<Poco::Int64>(static_cast<Poco::UInt64>(min) + offset); };
+
+        // Parts are compiled here, on this builder, workers get only detached queries and use their own sessions
+        std::vector<CompiledQuery> queries;
+        const auto reset_shard = [this]() {
+            _shard_key = StringType();
+            _shard_from.clear();
+            _shard_to.clear();
+        };
+        try {
+            for(std::size_t i = 0; i < shards and i * step <= range; ++i)
+            {
+                const auto offset = i * step;
+                reset_shard();
+                _shard_key = qualified_key;
+                // Outermost ranges are open, so rows added since reading bounds are not lost
+                if(i != 0)
+                    _shard_from.assign(1, Param(key_at(offset)));
+                if(step <= range - offset and i + 1 < shards)
+                    _shard_to.assign(1, Param(key_at(offset + step)));
+                queries.push_back(compile(table_name).detached());
+            }
+        }
+        catch(...) {
+            reset_shard();
+            throw;
+        }
+        reset_shard();
+        const auto key_cols = _merge_keys();
+        std::vector<std::future<Part>> results;
+        for(const auto &query : queries)
+            results.push_back(_submit_part(executor, _db_name, query, key_cols));
+        std::vector<Part> parts;
+        for(auto &result : results)
+            parts.push_back(result.get());
+        _table_data = _merge(parts);
+        _cut_to_limit();
+
+        return _table_data;
+    }
+
+    /**
+     * Getting data from several databases with the same schema (i.e. one file per month), using shared executor
+     *
+     * @param  std::vector<StringType> db_names names of databases
+     * @param  StringType table_name name of table
+     * @return Data rows of all databases
+     */
+    Data Select::get_from(const std::vector<StringType> &db_names, StringType table_name)
+    {
+        return get_from(AsyncExecutor::instance(), db_names, table_name);
+    }
+
+    /**
+     * Getting data from several databases with the same schema, every database is read by another worker
+     * Query is built once, on the session of this builder, and executed on sessions of the databases.
+     * Results are concatenated in order of db_names, or merged by order_by keys if sorting is set.
+     * The same restrictions as in parallel_get() apply: no grouping, DISTINCT or OFFSET across databases.
+     *
+     * @param  AsyncExecutor executor worker pool executing the queries
+     * @param  std::vector<StringType> db_names names of databases (files, URIs of replicas, ...)
+     * @param  StringType table_name name of table
+     * @return Data rows of all databases
+     */
+    Data Select::get_from(AsyncExecutor &executor, const std::vector<StringType> &db_names, StringType table_name)
+    {
+        assert(_group_by.empty() and ! _distinct and _offset.size == 0);
+        const auto query = compile(table_name).detached();
+        const auto key_cols = _merge_keys();
+        std::vector<std::future<Part>> results;
+        for(const auto &db_name : db_names)
+            results.push_back(_submit_part(executor, db_name, query, key_cols));
+        std::vector<Part> parts;
+        for(auto &result : results)
+            parts.push_back(result.get());
+        _table_data = _merge(parts);
+        _cut_to_limit();
+
+        return _table_data;
+    }
+
+    /**
+     * Every part of parallel_get() and get_from() is limited separately, so the whole result has to be cut too
+     */
+    void Select::_cut_to_limit()
+    {
+        const auto limit = ! _limit_param.empty() ? static_cast<std::size_t>(_limit_param.front().as_int())
+            : _limit.size != 0 ? static_cast<std::size_t>(std::stoull(_text(_limit).to_string())) : _table_data.size();
+        if(_table_data.size() > limit)
+            _table_data.resize(limit);
+    }
+
+    /**
+     * Queue detached query of the part, its rows are read with typed values of order keys
+     *
+     * @param  AsyncExecutor executor worker pool executing the query
+     * @param  StringType db_name name of database
+     * @param  CompiledQuery query detached query of the part
+     * @param  std::vector<std::size_t> key_cols positions of order keys in the result
+     * @return std::future<Part> rows of the part
+     */
+    std::future<Select::Part> Select::_submit_part(AsyncExecutor &executor, const StringType &db_name, const CompiledQuery &query,
+        const std::vector<std::size_t> &key_cols)
+    {
+        return executor.execute(db_name, [query, key_cols](Connection &connection) {
+            Part res;
+            res.rows = query.get(connection, key_cols, res.keys);
+            return res;
+        });
+    }
+
+    /**
+     * Positions of order_by keys in the result, parts are merged by them
+     * Merge compares values with BINARY collation, so keys with COLLATE are rejected
+     *
+     * @return std::vector<std::size_t> positions of the columns, in order of keys
+     */
+    std::vector<std::size_t> Select::_merge_keys() const
+    {
+        std::vector<std::size_t> res;
+        for(const auto &key : _order_by)
+        {
+            auto expr = _text(key.first).to_string();
+            std::transform(expr.begin(), expr.end(), expr.begin(), [](const unsigned char c) { return std::toupper(c); });
+            if(expr.find("COLLATE") != StringType::npos)
+                throw Poco::InvalidArgumentException("Parts can't be merged by key with collation: " + _text(key.first).to_string());
+            const auto it = std::find(_cols_list.begin(), _cols_list.end(), column_name(_text(key.first)));
+            assert(it != _cols_list.end());
+            res.push_back(static_cast<std::size_t>(it - _cols_list.begin()));
+        }
+
+        return res;
+    }
+
+    /**
+     * Joining results of parallel_get() parts
+     * Parts are sorted by order_by keys, so k-way merge keeps the order
+     *
+     * @param  std::vector<Part> parts results of the parts, in key order (rows are moved out)
+     * @return Data whole result
+     */
+    Data Select::_merge(std::vector<Part> &parts) const
+    {
+        Data res;
+        std::size_t total = 0;
+        for(const auto &part : parts)
+            total += part.rows.size();
+        res.reserve(total);
+        if(_order_by.empty())
+        {
+            for(auto &part : parts)
+                std::move(part.rows.begin(), part.rows.end(), std::back_inserter(res));
+            return res;
+        }
+
+        // Values are compared the way SQLite does (BINARY collation): NULL, numbers, text bytewise, blobs bytewise
+        const auto rank = [](const Param &value) {
+            switch(value.type())
+            {
+                case Param::TYPE::NONE: return 0;
+                case Param::TYPE::INTEGER: case Param::TYPE::REAL: return 1;
+                case Param::TYPE::TEXT: return 2;
+                case Param::TYPE::BLOB: return 3;
+            }
+            return 0;
+        };
+        const auto compare_values = [&rank](const Param &a, const Param &b) {
+            const auto a_rank = rank(a), b_rank = rank(b);
+            if(a_rank != b_rank)
+                return a_rank < b_rank ? -1 : 1;
+            switch(a.type())
+            {
+                case Param::TYPE::NONE:
+                    return 0;
+                case Param::TYPE::INTEGER: case Param::TYPE::REAL:
+                    if(a.type() == Param::TYPE::INTEGER and b.type() == Param::TYPE::INTEGER)
+                        return a.as_int() < b.as_int() ? -1 : (a.as_int() > b.as_int() ? 1 : 0);
+                    {
+                        const double a_num = a.type() == Param::TYPE::INTEGER ? static_cast<double>(a.as_int()) : a.as_real();
+                        const double b_num = b.type() == Param::TYPE::INTEGER ? static_cast<double>(b.as_int()) : b.as_real();
+                        return a_num < b_num ? -1 : (a_num > b_num ? 1 : 0);
+                    }
+                case Param::TYPE::TEXT:
+                    return a.as_text().compare(b.as_text());
+                case Param::TYPE::BLOB:
+                {
+                    const auto &a_blob = a.as_blob(), &b_blob = b.as_blob();
+                    const auto cmp = std::memcmp(a_blob.rawContent(), b_blob.rawContent(), std::min(a_blob.size(), b_blob.size()));
+                    return cmp != 0 ? cmp : (a_blob.size() < b_blob.size() ? -1 : (a_blob.size() > b_blob.size() ? 1 : 0));
+                }
+            }
+            return 0;
+        };
+        // Heap of the next row of every part, smallest on top
+        typedef std::pair<std::size_t, std::size_t> Head; /// Part and row
+        const auto keys = _order_by.size();
+        const auto heap_order = [&](const Head &a, const Head &b) {
+            const auto &a_keys = parts[a.first].keys, &b_keys = parts[b.first].keys;
+            for(std::size_t i = 0; i < keys; ++i)
+            {
+                const auto cmp = compare_values(a_keys[a.second * keys + i], b_keys[b.second * keys + i]);
+                if(cmp != 0)
+                    return _order_by[i].second == ORDER::ASC ? cmp > 0 : cmp < 0;
+            }
+            return false;
+        };
+        std::priority_queue<Head, std::vector<Head>, decltype(heap_order)> heads(heap_order);
+        for(std::size_t i = 0; i < parts.size(); ++i)
+            if( ! parts[i].rows.empty())
+                heads.emplace(i, 0);
+        while( ! heads.empty())
+        {
+            const auto head = heads.top();
+            heads.pop();
+            res.push_back(std::move(parts[head.first].rows[head.second]));
+            if(head.second + 1 < parts[head.first].rows.size())
+                heads.emplace(head.first, head.second + 1);
+        }
+
+        return res;
+    }
+
+    /**
+     * Name of the result column for the expression: `Accounts`.`id` -> id
+     *
+     * @param  StringRef expr column, possibly qualified with table name
+     * @return StringType column name
+     */
+    StringType Select::column_name(const StringRef expr)
+    {
+        const auto dot = expr.rfind('.');
+        auto res = expr.substr(dot == StringRef::npos ? 0 : dot + 1).to_string();
+        res.erase(std::remove(res.begin(), res.end(), '`'), res.end());
+
+        return res;
+    }
+
+    /**
+     * Getting data from table as typed columns
+     * Values are converted once to the column's storage instead of string per cell
+     * Storage follows declared type of the column, a column holding values of other types is stored as TEXT
+     *
+     * @param  StringType table_name name of table
+     * @return ColumnarData result stored by columns
+     */
+    ColumnarData Select::get_columnar(StringType table_name)
+    {
+        using namespace Poco::Data;
+
+        QueryTrace trace;
+        const auto shape = _shape(table_name, trace);
+        Statement &select = _ses->statements.prepare(_ses->session, shape);
+        trace.mark(STAGE::PREPARE);
         select.execute();
+        QueryCounter::inc();
+        trace.mark(STAGE::EXECUTE);
         RecordSet rs(select);
-        bool more = rs.moveFirst();
-        _table_data.clear();
-        while(more)
+        trace.mark(STAGE::FETCH);
+        std::vector<ColumnVector::TYPE> types;
+        for(std::size_t col_id = 0; col_id < _cols_list.size(); ++col_id)
         {
-            Row tmp;
-            for(auto col_id = 0; col_id < _cols_list.size(); ++col_id)
-                tmp[_cols_list[col_id]] = rs[col_id].convert<StringType>();
-            _table_data.push_back(tmp);
-            more = rs.moveNext();
+            switch(rs.columnType(col_id))
+            {
+                case MetaColumn::FDT_BOOL: case MetaColumn::FDT_INT8: case MetaColumn::FDT_UINT8:
+                case MetaColumn::FDT_INT16: case MetaColumn::FDT_UINT16: case MetaColumn::FDT_INT32:
+                case MetaColumn::FDT_UINT32: case MetaColumn::FDT_INT64: case MetaColumn::FDT_UINT64:
+                    types.push_back(ColumnVector::TYPE::INTEGER);
+                    break;
+                case MetaColumn::FDT_FLOAT: case MetaColumn::FDT_DOUBLE:
+                    types.push_back(ColumnVector::TYPE::REAL);
+                    break;
+                default:
+                    types.push_back(ColumnVector::TYPE::TEXT);
+            }
         }
-        QueryCounter::inc();
 
-        return _table_data;
+        ColumnarData res(_cols_list, types);
+        res.reserve(rs.rowCount());
+        for(std::size_t row = 0; row < rs.rowCount(); ++row)
+        {
+            for(std::size_t col_id = 0; col_id < types.size(); ++col_id)
+            {
+                // Value is stored by its own type, column changes to TEXT if they don't match
+                const auto val = rs.value(col_id, row);
+                if(val.isEmpty())
+                    res.push_null(col_id);
+                else if(val.isInteger())
+                    res.push_int(col_id, val.convert<Poco::Int64>());
+                else if(val.isNumeric())
+                    res.push_real(col_id, val.convert<double>());
+                else
+                    res.push_text(col_id, val.convert<StringType>());
+            }
+        }
+        trace.mark(STAGE::CONVERT);
+        trace.finish(res.rows(), res.memory_usage());
+        SlowQueryLog::check(*_ses, shape, trace, res.rows());
+
+        return res;
     }
 
     /**
@@ -148,13 +631,25 @@ namespace DB
     {
         _cols_list.clear();
         _cols_types.clear();
-        _where = WhereClauses();
+        _arena.clear();
+        _where.clear();
+        _where_params.clear();
         _distinct = false;
-        _group_by = StringType();
-        _order_by = StringType();
-        _limit = StringType();
-        _offset = StringType();
-        _columns = Columns();
+        _group_by.clear();
+        _having.clear();
+        _having_params.clear();
+        _order_by.clear();
+        _seek_after.clear();
+        _shard_key = StringType();
+        _shard_from.clear();
+        _shard_to.clear();
+        _limit = Fragment();
+        _offset = Fragment();
+        _limit_param.clear();
+        _offset_param.clear();
+        _columns.clear();
+        _joins.clear();
+        _cache_ttl = std::chrono::milliseconds(0);
 
         return (*this);
     }
@@ -162,53 +657,102 @@ namespace DB
     /**
      * Constructing SQL query
      *
+     * @param  StringType table_name name of table
+     * @param  Params params receives values of placeholders, in order of appearance
      * @return query string
      */
-    StringType Select::_construct_query(const StringType &table_name)
+    StringType Select::_construct_query(const StringType &table_name, Params &params) const
     {
-        StringType query = StringType("SELECT ");
+        StringType query;
+        query.reserve(_estimate_size(table_name));
+        query += "SELECT ";
         if(_distinct)
-            query += StringType("DISTINCT ");
-        query += _get_columns() + StringType(" FROM `") + table_name + StringType("` ");
-        query += _get_joins();
-        query += _get_where();
-        if(_group_by != StringType())
-            query += StringType(" GROUP BY ") + _group_by;
-        if(_order_by != StringType())
-            query += StringType(" ORDER BY ") + _order_by;
-        if(_limit != StringType())
-            query += StringType(" LIMIT ") + _limit;
-        if(_offset != StringType())
-            query += StringType(" OFFSET ") + _offset;
-        query += StringType(";");
-        #ifdef _DEBUG
-        std::cout << query << std::endl << std::endl;
-        #endif
+            query += "DISTINCT ";
+        _get_columns(table_name, query);
+        query.append(" FROM ").append(SchemaCache::quote(table_name)) += ' ';
+        _get_joins(query);
+        _get_where(query, params);
+        _get_group(query, params);
+        _get_order(query);
+        if(_limit.size != 0)
+        {
+            _append(query.append(" LIMIT "), _limit);
+            params.insert(params.end(), _limit_param.begin(), _limit_param.end());
+        }
+        if(_offset.size != 0)
+        {
+            _append(query.append(" OFFSET "), _offset);
+            params.insert(params.end(), _offset_param.begin(), _offset_param.end());
+        }
+        query += ';';
 
         return query;
     }
 
+    /**
+     * Upper bound of the query length, so it can be rendered without reallocations
+     *
+     * @param  StringType table_name name of table
+     * @return std::size_t number of characters
+     */
+    std::size_t Select::_estimate_size(const StringType &table_name) const
+    {
+        // Keywords and separators of all clauses
+        // Every fragment is rendered once, except order keys repeated in the seek condition
+        std::size_t res = 96 + table_name.size() + _arena.size() + 8 * _columns.size() + 5 * (_where.size() + _having.size())
+            + 2 * _group_by.size();
+        if(_columns.empty())
+            for(const auto &col : _cols_list)
+                res += table_name.size() + col.size() + 9;
+        for(const auto &key : _order_by)
+            res += 2 * key.first.size + 18;
+        for(const auto &join : _joins)
+            res += join.clause().size() + 1;
+
+        return res;
+    }
+
+    /**
+     * Build the query once, so it can be executed many times without rendering it again
+     * Builder state is not changed, so this object can still be modified and compiled again
+     *
+     * @param  StringType table_name name of table
+     * @return CompiledQuery query ready for execution
+     */
+    CompiledQuery Select::compile(StringType table_name)
+    {
+        return CompiledQuery(_ses, _shape(table_name), _cols_list);
+    }
+
     /**
      * Constructing part of where clause
      *
      * @param  WHERE type type of clause (AND/OR)
-     * @param  StringType lvalue left operand or whole part of clause
-     * @param  StringType op operator (= > < etc.) or right operand
-     * @param  StringType rvalue right operand
+     * @param  StringRef lvalue left operand or whole part of clause
+     * @param  StringRef op operator (= > < etc.) or right operand
+     * @param  StringRef rvalue right operand
      * @return Select
      */
-    Select& Select::where(const WHERE type, const StringType lvalue, const StringType op, const StringType rvalue)
+    Select& Select::where(const WHERE type, const StringRef lvalue, const StringRef op, const StringRef rvalue)
     {
-        StringType expr = StringType();
-        StringType val = StringType();
-        if(op == StringType())
-            expr = lvalue;
-        else if(rvalue == StringType())
-            expr = lvalue + StringType("=") + op;
-        else
-            expr = lvalue + op + rvalue;
-        // Push expression into the queue
-        _where.push(std::make_tuple(type, expr));
+        _where.push_back(_store_clause(type, lvalue, op, rvalue, _where_params.size()));
+        return (*this);
+    }
+
+    /**
+     * Constructing part of where clause with value bound to the placeholder
+     * Value is never pasted into the query, so one prepared statement serves all values
+     *
+     * @param  WHERE type type of clause (AND/OR)
+     * @param  StringRef lvalue left operand
+     * @param  StringRef op operator (= > < LIKE etc.)
+     * @param  Param rvalue value of right operand
+     * @return Select
+     */
+    Select& Select::where(const WHERE type, const StringRef lvalue, const StringRef op, const Param &rvalue)
+    {
+        _where.push_back(_store_bound_clause(type, lvalue, op, _where_params.size()));
+        _where_params.push_back(rvalue);
 
         return (*this);
     }
@@ -219,7 +763,40 @@ namespace DB
      *
      * @return Select
      */
-    Select& Select::where(const StringType lvalue, const StringType op, const StringType rvalue)
+    Select& Select::where(const StringRef lvalue, const StringRef op, const Param &rvalue)
+    {
+        return where(WHERE::OR, lvalue, op, rvalue);
+    }
+
+    /**
+     * Alias for Select::where(WHERE.OR, lvalue, op, rvalue);
+     * @see Select::where()
+     *
+     * @return Select
+     */
+    Select& Select::or_where(const StringRef lvalue, const StringRef op, const Param &rvalue)
+    {
+        return where(WHERE::OR, lvalue, op, rvalue);
+    }
+
+    /**
+     * Alias for Select::where(WHERE.AND, lvalue, op, rvalue);
+     * @see Select::where()
+     *
+     * @return Select
+     */
+    Select& Select::and_where(const StringRef lvalue, const StringRef op, const Param &rvalue)
+    {
+        return where(WHERE::AND, lvalue, op, rvalue);
+    }
+
+    /**
+     * Alias for Select::where(WHERE.OR, lvalue, op, rvalue);
+     * @see Select::where()
+     *
+     * @return Select
+     */
+    Select& Select::where(const StringRef lvalue, const StringRef op, const StringRef rvalue)
     {
         return where(WHERE::OR, lvalue, op, rvalue);
     }
@@ -230,7 +807,7 @@ namespace DB
      *
      * @return Select
      */
-    Select& Select::or_where(const StringType lvalue, const StringType op, const StringType rvalue)
+    Select& Select::or_where(const StringRef lvalue, const StringRef op, const StringRef rvalue)
     {
         return where(WHERE::OR, lvalue, op, rvalue);
     }
@@ -241,7 +818,7 @@ namespace DB
      *
      * @return Select
      */
-    Select& Select::and_where(const StringType lvalue, const StringType op, const StringType rvalue)
+    Select& Select::and_where(const StringRef lvalue, const StringRef op, const StringRef rvalue)
     {
         return where(WHERE::AND, lvalue, op, rvalue);
     }
@@ -258,42 +835,271 @@ namespace DB
     }
 
     /**
-     * Set grouping using certain column and direction
+     * Add column used for grouping
+     *
+     * @param  StringRef column name of the column (or expression) used for grouping
+     * @return Select
+     */
+    Select& Select::group_by(const StringRef column)
+    {
+        _group_by.push_back(_store(column));
+        return (*this);
+    }
+
+    /**
+     * Add columns used for grouping
+     *
+     * @param  std::vector<StringType> columns names of the columns used for grouping
+     * @return Select
+     */
+    Select& Select::group_by(const std::vector<StringType> columns)
+    {
+        for(const auto &column : columns)
+            _group_by.push_back(_store(column));
+        return (*this);
+    }
+
+    /**
+     * Constructing part of having clause, the same way as where clause
+     * Aggregates can be used through their aliases: having("count", ">", 10)
+     *
+     * @param  WHERE type type of clause (AND/OR)
+     * @param  StringRef lvalue left operand
+     * @param  StringRef op operator (= > < etc.) or right operand
+     * @param  StringRef rvalue right operand
+     * @return Select
+     */
+    Select& Select::having(const WHERE type, const StringRef lvalue, const StringRef op, const StringRef rvalue)
+    {
+        _having.push_back(_store_clause(type, lvalue, op, rvalue, _having_params.size()));
+        return (*this);
+    }
+
+    /**
+     * Alias for Select::having(WHERE.AND, lvalue, op, rvalue);
+     * @see Select::having()
+     *
+     * @return Select
+     */
+    Select& Select::having(const StringRef lvalue, const StringRef op, const StringRef rvalue)
+    {
+        return having(WHERE::AND, lvalue, op, rvalue);
+    }
+
+    /**
+     * Constructing part of having clause with value bound to the placeholder
+     *
+     * @param  WHERE type type of clause (AND/OR)
+     * @param  StringRef lvalue left operand
+     * @param  StringRef op operator (= > < etc.)
+     * @param  Param rvalue value of right operand
+     * @return Select
+     */
+    Select& Select::having(const WHERE type, const StringRef lvalue, const StringRef op, const Param &rvalue)
+    {
+        _having.push_back(_store_bound_clause(type, lvalue, op, _having_params.size()));
+        _having_params.push_back(rvalue);
+        return (*this);
+    }
+
+    /**
+     * Alias for Select::having(WHERE.AND, lvalue, op, rvalue);
+     * @see Select::having()
+     *
+     * @return Select
+     */
+    Select& Select::having(const StringRef lvalue, const StringRef op, const Param &rvalue)
+    {
+        return having(WHERE::AND, lvalue, op, rvalue);
+    }
+
+    /**
+     * Add COUNT() column
+     *
+     * @param  StringRef column counted column, * - all rows
+     * @param  StringRef alias name of the result column (default: count or count_column)
+     * @return Select
+     */
+    Select& Select::count(const StringRef column, const StringRef alias)
+    {
+        return _aggregate("COUNT", column, alias);
+    }
+
+    /**
+     * Add SUM() column
+     *
+     * @param  StringRef column summed column (or expression)
+     * @param  StringRef alias name of the result column (default: sum_column)
+     * @return Select
+     */
+    Select& Select::sum(const StringRef column, const StringRef alias)
+    {
+        return _aggregate("SUM", column, alias);
+    }
+
+    /**
+     * Add AVG() column
+     *
+     * @param  StringRef column averaged column (or expression)
+     * @param  StringRef alias name of the result column (default: avg_column)
+     * @return Select
+     */
+    Select& Select::avg(const StringRef column, const StringRef alias)
+    {
+        return _aggregate("AVG", column, alias);
+    }
+
+    /**
+     * Add MIN() column
+     *
+     * @param  StringRef column column (or expression)
+     * @param  StringRef alias name of the result column (default: min_column)
+     * @return Select
+     */
+    Select& Select::min(const StringRef column, const StringRef alias)
+    {
+        return _aggregate("MIN", column, alias);
+    }
+
+    /**
+     * Add MAX() column
+     *
+     * @param  StringRef column column (or expression)
+     * @param  StringRef alias name of the result column (default: max_column)
+     * @return Select
+     */
+    Select& Select::max(const StringRef column, const StringRef alias)
+    {
+        return _aggregate("MAX", column, alias);
+    }
+
+    /**
+     * Add GROUP_CONCAT() column
+     *
+     * @param  StringRef column concatenated column (or expression)
+     * @param  StringRef separator text between values, bound to the placeholder
+     * @param  StringRef alias name of the result column (default: group_concat_column)
+     * @return Select
+     */
+    Select& Select::group_concat(const StringRef column, const StringRef separator, const StringRef alias)
+    {
+        return _aggregate("GROUP_CONCAT", column, alias, separator);
+    }
+
+    /**
+     * Add aggregate column, written directly into the arena
+     *
+     * @param  StringRef function name of SQL function
+     * @param  StringRef column argument of the function
+     * @param  StringRef alias name of the result column, empty - function_column in lowercase
+     * @param  StringRef separator second argument, written as string literal (empty - none)
+     * @return Select
+     */
+    Select& Select::_aggregate(const StringRef function, const StringRef column, const StringRef alias, const StringRef separator)
+    {
+        assert( ! column.empty());
+        Fragment expr = {_arena.size(), 0};
+        append(append(_arena, function) += '(', column);
+        if( ! separator.empty())
+        {
+            // Literal is replaced by placeholder by normalize(), so it doesn't change the shape of the query
+            _arena.append(", '");
+            for(const char c : separator)
+            {
+                if(c == '\'')
+                    _arena += '\'';
+                _arena += c;
+            }
+            _arena += '\'';
+        }
+        _arena += ')';
+        expr.size = _arena.size() - expr.begin;
+
+        Fragment name = {_arena.size(), 0};
+        if( ! alias.empty())
+            append(_arena, alias);
+        else
+        {
+            for(const char c : function)
+                _arena += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            if(column != "*")
+                _arena.append(1, '_').append(column_name(column));
+        }
+        name.size = _arena.size() - name.begin;
+        _columns.emplace_back(expr, name);
+
+        return (*this);
+    }
+
+    /**
+     * Add sort key, keys added earlier are more significant: order_by("name").order_by("id", ORDER::DESC)
      *
-     * @param  StringType column name of the column used for grouping
+     * @param  StringRef column name of the column (or expression, i.e. alias of aggregate) used for sorting
+     * @param  StringType type direction of sorting
      * @return Select
      */
-    Select& Select::group_by(const StringType column)
+    Select& Select::order_by(const StringRef column, const ORDER type)
     {
-        _group_by = column;
+        _order_by.emplace_back(_store(column), type);
         return (*this);
     }
 
     /**
-     * Set sorting using certain column and direction
+     * Add sort keys with the same direction
      *
-     * @param  StringType column name of the column used for sorting
+     * @param  std::vector<StringType> columns names of the columns used for sorting, most significant first
      * @param  StringType type direction of sorting
      * @return Select
      */
-    Select& Select::order_by(const StringType column, const ORDER type)
+    Select& Select::order_by(const std::vector<StringType> columns, const ORDER type)
     {
-        _order_by = column + StringType(type == ORDER::ASC ? " ASC" : " DESC");
+        for(const auto &column : columns)
+            _order_by.emplace_back(_store(column), type);
+        return (*this);
+    }
+
+    /**
+     * Names of the columns used for sorting
+     *
+     * @return ColsInfo order keys, most significant first
+     */
+    ColsInfo Select::order_keys() const
+    {
+        ColsInfo res;
+        for(const auto &key : _order_by)
+            res.push_back(_text(key.first).to_string());
+
+        return res;
+    }
+
+    /**
+     * Read only rows following the row with given values of order keys (keyset pagination)
+     * Unlike OFFSET, preceding rows are not read at all, so cost of the page doesn't depend on its number
+     * Keys should identify the row uniquely (i.e. end with primary key), otherwise rows could be skipped
+     *
+     * @param  Params after values of order_by keys in the last row of previous page (Param() for NULL), empty - first page
+     * @return Select
+     */
+    Select& Select::seek(const Params after)
+    {
+        assert(after.empty() or after.size() == _order_by.size());
+        _seek_after = after;
         return (*this);
     }
 
     /**
      * Set limit and, optionally offset for the query
      *
-     * @param  StringType limit setted limi for query
-     * @param  StringType offset number of ommitted rows
+     * @param  StringRef limit setted limi for query
+     * @param  StringRef offset number of ommitted rows
      * @return Select
      */
-    Select& Select::limit(const StringType limit, const StringType offset)
+    Select& Select::limit(const StringRef limit, const StringRef offset)
     {
-        assert(limit != StringType("0"));
-        _limit = limit;
-        if(offset != StringType())
+        assert(limit != "0");
+        _limit = _store(limit);
+        _limit_param.clear();
+        if( ! offset.empty())
             this->offset(offset);
         return (*this);
     }
@@ -301,25 +1107,80 @@ namespace DB
     /**
      * Set offset for the query
      *
-     * @param  StringType offset number of ommitted rows
+     * @param  StringRef offset number of ommitted rows
+     * @return Select
+     */
+    Select& Select::offset(const StringRef offset)
+    {
+        _offset = _store(offset);
+        _offset_param.clear();
+        return (*this);
+    }
+
+    /**
+     * Set limit and, optionally offset for the query, both bound as parameters
+     *
+     * @param  unsigned long limit setted limit for query
+     * @param  unsigned long offset number of ommitted rows (0 - no offset)
+     * @return Select
+     */
+    Select& Select::limit(const unsigned long limit, const unsigned long offset)
+    {
+        assert(limit != 0);
+        _limit = _store("?");
+        _limit_param.assign(1, Param(limit));
+        if(offset != 0)
+            this->offset(offset);
+        return (*this);
+    }
+
+    /**
+     * Set offset for the query, bound as parameter
+     *
+     * @param  unsigned long offset number of ommitted rows
+     * @return Select
+     */
+    Select& Select::offset(const unsigned long offset)
+    {
+        _offset = _store("?");
+        _offset_param.assign(1, Param(offset));
+        return (*this);
+    }
+
+    /**
+     * Remove limit of the query (offset is kept)
+     *
+     * @return Select
+     */
+    Select& Select::clear_limit()
+    {
+        _limit = Fragment();
+        _limit_param.clear();
+        return (*this);
+    }
+
+    /**
+     * Remove offset of the query
+     *
      * @return Select
      */
-    Select& Select::offset(const StringType offset)
+    Select& Select::clear_offset()
     {
-        _offset = offset;
+        _offset = Fragment();
+        _offset_param.clear();
         return (*this);
     }
 
     /**
      * Set column name with optional alias
      *
-     * @param  StringType column name of the added column
-     * @param  StringType (optional) alias  for the column
+     * @param  StringRef column name of the added column
+     * @param  StringRef (optional) alias  for the column
      * @return Select
      */
-    Select& Select::columns(const StringType column, const StringType alias)
+    Select& Select::columns(const StringRef column, const StringRef alias)
     {
-        _columns.emplace(column, alias);
+        _columns.emplace_back(_store(column), _store(alias));
         return (*this);
     }
 
@@ -331,8 +1192,7 @@ namespace DB
      */
     Select& Select::columns(const Column col)
     {
-        _columns.push(col);
-        return (*this);
+        return columns(col.first, col.second);
     }
 
     /**
@@ -343,7 +1203,7 @@ namespace DB
      */
     Select& Select::columns(const std::vector<StringType> cols)
     {
-        std::for_each(cols.begin(), cols.end(), [&](const StringType &x) {_columns.emplace(x, StringType()); });
+        std::for_each(cols.begin(), cols.end(), [&](const StringType &x) { columns(x); });
         return (*this);
     }
 
@@ -355,53 +1215,302 @@ namespace DB
      */
     Select& Select::columns(const std::vector<Column> cols)
     {
-        std::for_each(cols.begin(), cols.end(), [&](const Column &x) { _columns.push(x); });
+        std::for_each(cols.begin(), cols.end(), [&](const Column &x) { columns(x.first, x.second); });
         return (*this);
     }
 
     /**
      * Full list of columns suited for using int the SELECT statement
+     * Instead of * columns of the table are listed by name, as they are cached, so values always match their names
+     * (if the table was changed since it was cached, query fails on missing column)
      *
-     * @return StringType list of columns
+     * @param  StringType table_name name of table
+     * @param  StringType query receives list of columns
+     * @return void
      */
-    StringType Select::_get_columns()
+    void Select::_get_columns(const StringType &table_name, StringType &query) const
     {
-        StringType res = StringType("");
+        if(_columns.empty() and _cols_list.empty())
+        {
+            query += '*';
+            return;
+        }
         if(_columns.empty())
-            return StringType("*");
-        while( ! _columns.empty())
         {
-            const auto tmp = _columns.front();
-            res += tmp.first;
-            if(tmp.second != StringType())
-                res += StringType(" AS `") + tmp.second + StringType("`");
-            _columns.pop();
-            if( ! _columns.empty())
-                res += StringType(", ");
+            const auto table = SchemaCache::quote(table_name);
+            for(auto it = _cols_list.begin(); it != _cols_list.end(); ++it)
+            {
+                if(it != _cols_list.begin())
+                    query += ", ";
+                query.append(table).append(".`").append(*it) += '`';
+            }
+            return;
+        }
+        for(auto it = _columns.begin(); it != _columns.end(); ++it)
+        {
+            if(it != _columns.begin())
+                query += ", ";
+            _append(query, it->first);
+            if(it->second.size != 0)
+                _append(query.append(" AS `"), it->second) += '`';
+        }
+    }
+
+    /**
+     * Constructing WHERE part of the SQL query
+     *
+     * @param  StringType query receives full WHERE clause
+     * @param  Params params receives values bound in where clauses
+     * @return void
+     */
+    void Select::_get_where(StringType &query, Params &params) const
+    {
+        const bool seek = ! _seek_after.empty();
+        const bool shard = _shard_key != StringType();
+        if(_where.empty() and ! seek and ! shard)
+            return;
+        query += " WHERE ";
+        // Seek and shard conditions have to apply to all where clauses, whatever their types are
+        const bool wrap = ! _where.empty() and (seek or shard);
+        if(wrap)
+            query += '(';
+        _get_clauses(query, _where, _where_params, params);
+        if(wrap)
+            query += ") AND ";
+        if(seek)
+            _get_seek(query, params);
+        if(seek and shard)
+            query += " AND ";
+        if(shard)
+            _get_shard(query, params);
+    }
+
+    /**
+     * Constructing conditions of where or having clause
+     *
+     * @param  StringType query receives conditions joined with AND/OR
+     * @param  WhereClauses clauses conditions
+     * @param  Params values values bound in the conditions
+     * @param  Params params receives values bound in the conditions
+     * @return void
+     */
+    void Select::_get_clauses(StringType &query, const WhereClauses &clauses, const Params &values, Params &params) const
+    {
+        for(auto it = clauses.begin(); it != clauses.end(); ++it)
+        {
+            if(it != clauses.begin())
+                query += it->type == WHERE::OR ? " OR " : " AND ";
+            _append(query, it->expr);
+            const auto first = values.begin() + it->params_begin;
+            params.insert(params.end(), first, first + it->params_size);
         }
+    }
+
+    /**
+     * Constructing GROUP BY and HAVING parts of the SQL query
+     *
+     * @param  StringType query receives the clauses
+     * @param  Params params receives values bound in having clauses
+     * @return void
+     */
+    void Select::_get_group(StringType &query, Params &params) const
+    {
+        if( ! _group_by.empty())
+        {
+            query += " GROUP BY ";
+            for(auto it = _group_by.begin(); it != _group_by.end(); ++it)
+                _append(query.append(it != _group_by.begin() ? ", " : ""), *it);
+        }
+        if(_having.empty())
+            return;
+        query += " HAVING ";
+        _get_clauses(query, _having, _having_params, params);
+    }
+
+    /**
+     * Constructing condition selecting key range of parallel_get() worker
+     *
+     * @param  StringType query receives the condition
+     * @param  Params params receives bounds of the range
+     * @return void
+     */
+    void Select::_get_shard(StringType &query, Params &params) const
+    {
+        assert( ! _shard_from.empty() or ! _shard_to.empty());
+        if( ! _shard_from.empty())
+        {
+            query.append(_shard_key) += " >= ?";
+            params.push_back(_shard_from.front());
+        }
+        if( ! _shard_from.empty() and ! _shard_to.empty())
+            query += " AND ";
+        if( ! _shard_to.empty())
+        {
+            query.append(_shard_key) += " < ?";
+            params.push_back(_shard_to.front());
+        }
+    }
+
+    /**
+     * Constructing condition of keyset pagination
+     * Ascending keys after non-NULL values are compared as row value: (k1, k2) > (?, ?)
+     * Otherwise the condition is expanded, NULLs sort first (before any value): k1 > ? OR (k1 = ? AND (k2 < ? OR k2 IS NULL))
+     *
+     * @param  StringType query receives the condition
+     * @param  Params params receives values of order keys (NULL keys are rendered, not bound)
+     * @return void
+     */
+    void Select::_get_seek(StringType &query, Params &params) const
+    {
+        assert(_seek_after.size() == _order_by.size());
+        const auto ascending = std::all_of(_order_by.begin(), _order_by.end(),
+            [](const OrderKeys::value_type &key) { return key.second == ORDER::ASC; });
+        const auto nulls = std::any_of(_seek_after.begin(), _seek_after.end(), [](const Param &val) { return val.is_null(); });
+        if(ascending and ! nulls)
+        {
+            const auto multi = _order_by.size() > 1;
+            if(multi)
+                query += '(';
+            for(auto it = _order_by.begin(); it != _order_by.end(); ++it)
+            {
+                if(it != _order_by.begin())
+                    query += ", ";
+                _append(query, it->first);
+            }
+            query += multi ? ") > (" : " > ";
+            for(std::size_t i = 0; i < _seek_after.size(); ++i)
+                query += i == 0 ? "?" : ", ?";
+            if(multi)
+                query += ')';
+            params.insert(params.end(), _seek_after.begin(), _seek_after.end());
+            return;
+        }
+
+        query += '(';
+        bool first = true;
+        for(std::size_t i = 0; i < _order_by.size(); ++i)
+        {
+            // Nothing sorts after NULL in descending order
+            if(_order_by[i].second == ORDER::DESC and _seek_after[i].is_null())
+                continue;
+            if( ! first)
+                query += " OR ";
+            if(i != 0)
+                query += '(';
+            for(std::size_t j = 0; j < i; ++j)
+            {
+                _append(query, _order_by[j].first) += _seek_after[j].is_null() ? " IS NULL AND " : " = ? AND ";
+                if( ! _seek_after[j].is_null())
+                    params.push_back(_seek_after[j]);
+            }
+            if(_order_by[i].second == ORDER::ASC and _seek_after[i].is_null())
+                _append(query, _order_by[i].first) += " IS NOT NULL";
+            else if(_order_by[i].second == ORDER::ASC)
+                _append(query, _order_by[i].first) += " > ?";
+            else
+            {
+                // Branches are joined with OR, so only nested comparison needs parentheses
+                if(i != 0)
+                    query += '(';
+                _append(query, _order_by[i].first) += " < ? OR ";
+                _append(query, _order_by[i].first) += " IS NULL";
+                if(i != 0)
+                    query += ')';
+            }
+            if( ! _seek_after[i].is_null())
+                params.push_back(_seek_after[i]);
+            if(i != 0)
+                query += ')';
+            first = false;
+        }
+        if(first)
+            query += '0';
+        query += ')';
+    }
+
+    /**
+     * Constructing ORDER BY part of the SQL query
+     *
+     * @param  StringType query receives full ORDER BY clause
+     * @return void
+     */
+    void Select::_get_order(StringType &query) const
+    {
+        if(_order_by.empty())
+            return;
+        query += " ORDER BY ";
+        for(auto it = _order_by.begin(); it != _order_by.end(); ++it)
+        {
+            if(it != _order_by.begin())
+                query += ", ";
+            _append(query, it->first).append(it->second == ORDER::ASC ? " ASC" : " DESC");
+        }
+    }
+
+    /**
+     * Copy text into the arena
+     *
+     * @param  StringRef text part of the query
+     * @return Fragment position of the text in the arena
+     */
+    Select::Fragment Select::_store(const StringRef text)
+    {
+        const Fragment res = {_arena.size(), text.size()};
+        append(_arena, text);
 
         return res;
     }
 
     /**
-     * Constructing WHERE part of the SQL query
+     * Write condition into the arena
+     * Operands are kept as parts of the condition, so its structure can be inspected (i.e. by IndexAdvisor)
      *
-     * @return full WHERE clause
+     * @param  WHERE type type of clause (AND/OR)
+     * @param  StringRef lvalue left operand
+     * @param  StringRef op operator (= > < etc.) or right operand
+     * @param  StringRef rvalue right operand
+     * @param  std::size_t params_begin position of the clause's values
+     * @return WhereClause clause without bound values
      */
-    StringType Select::_get_where()
+    Select::WhereClause Select::_store_clause(const WHERE type, const StringRef lvalue, const StringRef op, const StringRef rvalue,
+        const std::size_t params_begin)
     {
-        StringType res;
-        if(_where.empty())
-            return res;
-        while( ! _where.empty())
+        WhereClause res = {type, {_arena.size(), 0}, {_arena.size(), lvalue.size()}, Fragment(), params_begin, 0};
+        append(_arena, lvalue);
+        if( ! op.empty() and rvalue.empty())
+        {
+            res.op = Fragment{_arena.size(), 1};
+            append(_arena += '=', op);
+        }
+        else if( ! op.empty())
         {
-            if(res != StringType())
-                res += std::get<0>(_where.front()) == WHERE::OR ? StringType(" OR ") : StringType(" AND ");
-            res += std::get<1>(_where.front());
-            _where.pop();
+            res.op = Fragment{_arena.size(), op.size()};
+            append(append(_arena, op), rvalue);
         }
+        res.expr.size = _arena.size() - res.expr.begin;
 
-        return StringType(" WHERE ") + res;
+        return res;
+    }
+
+    /**
+     * Write condition comparing with placeholder into the arena
+     *
+     * @param  WHERE type type of clause (AND/OR)
+     * @param  StringRef lvalue left operand
+     * @param  StringRef op operator (= > < LIKE etc.)
+     * @param  std::size_t params_begin position of the clause's value
+     * @return WhereClause clause with one bound value
+     */
+    Select::WhereClause Select::_store_bound_clause(const WHERE type, const StringRef lvalue, const StringRef op, const std::size_t params_begin)
+    {
+        assert( ! lvalue.empty() and ! op.empty());
+        WhereClause res = {type, {_arena.size(), 0}, {_arena.size(), lvalue.size()}, Fragment(), params_begin, 1};
+        append(_arena, lvalue) += ' ';
+        res.op = Fragment{_arena.size(), op.size()};
+        append(_arena, op).append(" ?");
+        res.expr.size = _arena.size() - res.expr.begin;
+
+        return res;
     }
 
     /**
@@ -412,27 +1521,20 @@ namespace DB
      */
     Select& Select::join(const Join &join)
     {
-        _joins.push(join);
+        _joins.push_back(join);
         return (*this);
     }
 
     /**
      * Get all join clauses
      *
-     * @return StringType string usable in Select Statement
+     * @param  StringType query receives string usable in Select Statement
+     * @return void
      */
-    StringType Select::_get_joins()
+    void Select::_get_joins(StringType &query) const
     {
-        StringType res;
-        if(_joins.empty())
-            return res;
-        while( ! _joins.empty())
-        {
-            res += _joins.front().get_string() + " ";
-            _joins.pop();
-        }
-
-        return res;
+        for(const auto &join : _joins)
+            append(query, join.clause()) += ' ';
     }
 } // End namespace DB
 
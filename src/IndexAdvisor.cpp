@@ -0,0 +1,467 @@
+#include "IndexAdvisor.h"
+#include <algorithm>
+#include <sstream>
+#include <cctype>
+#include <iterator>
+
+namespace DB
+{
+    namespace
+    {
+        /// What does the expression refer to
+        enum class REF { COLUMN, OTHER_TABLE, EXPRESSION };
+
+        StringRef trim(StringRef text)
+        {
+            while( ! text.empty() and std::isspace(static_cast<unsigned char>(text.front())))
+                text.remove_prefix(1);
+            while( ! text.empty() and std::isspace(static_cast<unsigned char>(text.back())))
+                text.remove_suffix(1);
+            return text;
+        }
+
+        StringType upper(const StringRef text)
+        {
+            StringType res;
+            for(const char c : text)
+                res += static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+            return res;
+        }
+
+        bool same_name(const StringRef a, const StringRef b)
+        {
+            return a.size() == b.size() and upper(a) == upper(b);
+        }
+
+        bool contains(const ColsInfo &cols, const StringRef name)
+        {
+            return std::any_of(cols.begin(), cols.end(), [&](const StringType &col) { return same_name(col, name); });
+        }
+
+        /**
+         * Checking if expression is plain column of the table (optionally qualified with its name)
+         *
+         * @param  StringRef expr expression
+         * @param  StringType table name of the table
+         * @param  StringType name receives name of the column
+         * @return REF kind of the expression
+         */
+        REF reference(StringRef expr, const StringType &table, StringType &name)
+        {
+            expr = trim(expr);
+            if(expr.empty() or std::any_of(expr.begin(), expr.end(),
+                    [](const char c) { return ! std::isalnum(static_cast<unsigned char>(c)) and c != '_' and c != '`' and c != '.'; }))
+                return REF::EXPRESSION;
+            const auto dot = expr.rfind('.');
+            if(dot != StringRef::npos)
+            {
+                auto qualifier = expr.substr(0, dot).to_string();
+                qualifier.erase(std::remove(qualifier.begin(), qualifier.end(), '`'), qualifier.end());
+                // Table of attached database can be referenced without the schema too
+                if( ! same_name(qualifier, table) and ! same_name(qualifier, SchemaCache::split(table).second))
+                    return REF::OTHER_TABLE;
+            }
+            name = Select::column_name(expr);
+
+            return name.empty() or std::isdigit(static_cast<unsigned char>(name.front())) ? REF::EXPRESSION : REF::COLUMN;
+        }
+
+        /**
+         * Adding column read by the expression: plain column or argument of function (i.e. aggregate)
+         *
+         * @param  StringRef expr expression
+         * @param  IndexAdvisor::Usage usage receives the column
+         */
+        void read_column(const StringRef expr, IndexAdvisor::Usage &usage)
+        {
+            StringType name;
+            auto ref = reference(expr, usage.table, name);
+            const auto open = expr.find('(');
+            const auto close = expr.rfind(')');
+            if(ref == REF::EXPRESSION and open != StringRef::npos and close != StringRef::npos and open < close)
+            {
+                auto arg = expr.substr(open + 1, close - open - 1);
+                arg = trim(arg.substr(0, arg.find(',')));
+                if(arg == "*")
+                    return;
+                ref = reference(arg, usage.table, name);
+            }
+            if(ref == REF::COLUMN)
+                usage.columns.push_back(name);
+            else if(ref == REF::EXPRESSION)
+                usage.all_columns = true;
+        }
+
+        void push_unique(ColsInfo &cols, const StringType &name)
+        {
+            if( ! same_name(name, "rowid") and ! contains(cols, name))
+                cols.push_back(name);
+        }
+
+        /// Name of the index column without direction
+        StringRef key_name(const StringRef key)
+        {
+            return key.ends_with(" DESC") ? key.substr(0, key.size() - 5) : key;
+        }
+    }
+
+    /**
+     * Capture query of the workload
+     *
+     * @param  Select select query (compiled here, so it has to be complete)
+     * @param  StringType table_name name of table
+     * @return IndexAdvisor
+     */
+    IndexAdvisor& IndexAdvisor::add(Select &select, const StringType &table_name)
+    {
+        const auto query = select.compile(table_name);
+        _queries.push_back(Query{QueryShape{query.sql(), query.params()}, usage(select, table_name)});
+
+        return (*this);
+    }
+
+    /**
+     * Remove captured queries
+     *
+     * @return IndexAdvisor
+     */
+    IndexAdvisor& IndexAdvisor::clear()
+    {
+        _queries.clear();
+        return (*this);
+    }
+
+    /**
+     * Check plans of captured queries and suggest indexes
+     *
+     * @return std::vector<Advice> advice for each query, in order of adding
+     */
+    std::vector<IndexAdvisor::Advice> IndexAdvisor::advise()
+    {
+        std::vector<Advice> res;
+        if(_queries.empty())
+            return res;
+
+        auto connection = SessionPool::get(_db_name)->acquire();
+        std::map<StringType, ColsInfo> tables;
+        std::map<StringType, Indexes> indexes;
+        for(const auto &query : _queries)
+        {
+            const auto &table = query.usage.table;
+            Advice advice;
+            advice.sql = query.shape.text;
+            try {
+                advice.plan = SlowQueryLog::explain(*connection, query.shape);
+            }
+            catch(const std::exception &e) {
+                advice.plan = std::string("EXPLAIN failed: ") + e.what();
+            }
+            advice.temp_btree = advice.plan.find("USE TEMP B-TREE") != StringType::npos;
+            std::size_t begin = 0;
+            while(begin < advice.plan.size())
+            {
+                // SQLite < 3.24 writes "SCAN TABLE name", newer versions "SCAN name"
+                const auto end = std::min(advice.plan.find(" | ", begin), advice.plan.size());
+                const auto step = StringRef(advice.plan).substr(begin, end - begin);
+                if(step.starts_with("SCAN ") and step.find(SchemaCache::split(table).second) != StringRef::npos and step.find(" USING ") == StringRef::npos)
+                    advice.table_scan = true;
+                begin = end + 3;
+            }
+
+            if(tables.find(table) == tables.end())
+            {
+                tables[table] = SchemaCache::get(*connection, _db_name, table).names;
+                indexes[table] = _indexes(*connection, table);
+            }
+            const auto usage = _known_columns(query.usage, tables[table]);
+            advice.index = candidate(usage, advice.covering);
+            if( ! advice.index.empty())
+                advice.existing = _serving_index(indexes[table], usage, advice.index);
+            if( ! advice.index.empty() and advice.existing.empty())
+                advice.ddl = ddl(table, advice.index);
+            res.push_back(advice);
+        }
+
+        return res;
+    }
+
+    /**
+     * Columns of the table used by the query
+     * Only conditions joined with AND can use index, so columns of OR-ed conditions are just read
+     *
+     * @param  Select select query
+     * @param  StringType table_name name of table
+     * @return Usage columns by their role
+     */
+    IndexAdvisor::Usage IndexAdvisor::usage(const Select &select, const StringType &table_name)
+    {
+        Usage res;
+        res.table = table_name != StringType() ? table_name : select._table_name;
+        StringType name;
+
+        const auto any_or = std::any_of(select._where.begin() + std::min<std::size_t>(select._where.size(), 1), select._where.end(),
+            [](const Select::WhereClause &clause) { return clause.type == WHERE::OR; });
+        for(const auto &clause : select._where)
+        {
+            const auto ref = reference(select._text(clause.lvalue), res.table, name);
+            if(ref == REF::EXPRESSION)
+                res.all_columns = true;
+            if(ref != REF::COLUMN)
+                continue;
+            const auto op = upper(trim(select._text(clause.op)));
+            if( ! any_or and (op == "=" or op == "==" or op == "IS" or op == "IN"))
+                res.equality.push_back(name);
+            else if( ! any_or and (op == "<" or op == ">" or op == "<=" or op == ">=" or op == "BETWEEN" or op == "LIKE" or op == "GLOB"))
+                res.range.push_back(name);
+            else
+                res.columns.push_back(name);
+        }
+
+        // Index can serve only the leading plain columns of ORDER BY
+        for(const auto &key : select._order_by)
+        {
+            if(reference(select._text(key.first), res.table, name) != REF::COLUMN)
+                break;
+            res.order.emplace_back(name, key.second);
+        }
+        if(select._order_by.empty())
+            for(const auto &group : select._group_by)
+            {
+                if(reference(select._text(group), res.table, name) != REF::COLUMN)
+                    break;
+                res.order.emplace_back(name, ORDER::ASC);
+            }
+
+        if(select._columns.empty())
+            res.all_columns = true;
+        for(const auto &column : select._columns)
+            read_column(select._text(column.first), res);
+        for(const auto &join : select._joins)
+        {
+            // Columns compared in ON
+            const auto clause = join.clause();
+            const auto on = clause.find(" ON ");
+            if(on == StringRef::npos)
+                continue;
+            const auto condition = clause.substr(on + 4);
+            const auto eq = condition.find(" = ");
+            read_column(condition.substr(0, eq), res);
+            if(eq != StringRef::npos)
+                read_column(condition.substr(eq + 3), res);
+        }
+
+        return res;
+    }
+
+    /**
+     * Columns of the index serving the query: equality columns, sort keys (or the first range column),
+     * then other used columns, if the index can be covering
+     *
+     * @param  Usage usage columns used by the query
+     * @param  bool covering receives true if index contains all used columns
+     * @return ColsInfo columns of the index, empty if no index would help
+     */
+    ColsInfo IndexAdvisor::candidate(const Usage &usage, bool &covering)
+    {
+        ColsInfo res;
+        covering = false;
+        for(const auto &col : usage.equality)
+            push_unique(res, col);
+        for(const auto &key : usage.order)
+            if( ! contains(res, key.first) and ! same_name(key.first, "rowid"))
+                res.push_back(key.second == ORDER::DESC ? key.first + " DESC" : key.first);
+        if(usage.order.empty() and ! usage.range.empty())
+            push_unique(res, usage.range.front());
+        if(res.empty())
+            return res;
+
+        ColsInfo keys;
+        for(const auto &col : res)
+            keys.push_back(key_name(col).to_string());
+        ColsInfo rest;
+        for(const auto &list : {&usage.range, &usage.columns})
+            for(const auto &col : *list)
+                if( ! contains(keys, col))
+                    push_unique(rest, col);
+        if( ! usage.all_columns and res.size() + rest.size() <= MAX_COLUMNS)
+        {
+            res.insert(res.end(), rest.begin(), rest.end());
+            covering = true;
+        }
+
+        return res;
+    }
+
+    /**
+     * Statement creating the index
+     *
+     * Index of table in attached database is created in that database: CREATE INDEX `archive`.`idx_Users_id` ON `Users`
+     *
+     * @param  StringType table name of table, optionally with the schema
+     * @param  ColsInfo index columns of the index (with DESC suffix for descending keys)
+     * @return StringType CREATE INDEX statement
+     */
+    StringType IndexAdvisor::ddl(const StringType &table, const ColsInfo &index)
+    {
+        const auto qualified = SchemaCache::split(table);
+        StringType name = "idx_" + qualified.second;
+        StringType cols;
+        for(const auto &col : index)
+        {
+            const auto key = key_name(col);
+            name.append(1, '_').append(key.data(), key.size());
+            if(key.size() != col.size())
+                name += "_desc";
+            cols.append(cols.empty() ? "`" : ", `").append(key.data(), key.size()) += '`';
+            cols.append(col, key.size(), StringType::npos);
+        }
+
+        return "CREATE INDEX IF NOT EXISTS " + SchemaCache::quote(qualified.first.empty() ? name : qualified.first + "." + name)
+            + " ON `" + qualified.second + "` (" + cols + ");";
+    }
+
+    /**
+     * Advice as a single line of text
+     *
+     * @param  Advice advice advice for the query
+     * @return std::string report line
+     */
+    std::string IndexAdvisor::format(const Advice &advice)
+    {
+        std::ostringstream out;
+        out << advice.sql << " | plan: " << advice.plan;
+        if(advice.temp_btree)
+            out << " | sort in temp b-tree";
+        if(advice.table_scan)
+            out << " | table scan";
+        if( ! advice.existing.empty())
+            out << " | served by index `" << advice.existing << '`';
+        else if( ! advice.ddl.empty())
+            out << " | suggested" << (advice.covering ? " covering" : "") << " index: " << advice.ddl;
+        else
+            out << " | no index suggested";
+
+        return out.str();
+    }
+
+    /**
+     * Dropping columns which don't exist in the table (i.e. aliases of aggregates or columns of joined tables)
+     *
+     * @param  Usage usage columns used by the query
+     * @param  ColsInfo names columns of the table (empty - table unknown, usage is not changed)
+     * @return Usage columns of the table
+     */
+    IndexAdvisor::Usage IndexAdvisor::_known_columns(const Usage &usage, const ColsInfo &names)
+    {
+        if(names.empty())
+            return usage;
+        const auto known = [&](const StringType &col) { return same_name(col, "rowid") or contains(names, col); };
+
+        Usage res;
+        res.table = usage.table;
+        res.all_columns = usage.all_columns;
+        std::copy_if(usage.equality.begin(), usage.equality.end(), std::back_inserter(res.equality), known);
+        std::copy_if(usage.range.begin(), usage.range.end(), std::back_inserter(res.range), known);
+        std::copy_if(usage.columns.begin(), usage.columns.end(), std::back_inserter(res.columns), known);
+        for(const auto &key : usage.order)
+        {
+            if( ! known(key.first))
+                break;
+            res.order.push_back(key);
+        }
+
+        return res;
+    }
+
+    /**
+     * Find existing index serving the query as well as the suggested one
+     * Equality columns can be in any order, sort keys have to follow them
+     *
+     * @param  Indexes indexes existing indexes of the table
+     * @param  Usage usage columns used by the query
+     * @param  ColsInfo index columns of the suggested index
+     * @return StringType name of the index, empty - none
+     */
+    StringType IndexAdvisor::_serving_index(const Indexes &indexes, const Usage &usage, const ColsInfo &index)
+    {
+        Usage keys_only = usage;
+        keys_only.all_columns = true;
+        bool covering = false;
+        const auto keys = candidate(keys_only, covering);
+        std::size_t equality = 0;
+        for(; equality < keys.size() and contains(usage.equality, keys[equality]); ++equality);
+
+        const auto descending = [](const StringRef key) { return key.ends_with(" DESC"); };
+        for(const auto &existing : indexes)
+        {
+            const auto &cols = existing.second;
+            if(cols.size() < keys.size())
+                continue;
+            bool serves = true;
+            // Index can be scanned backwards, so order keys need either the same or all opposite directions
+            std::size_t same_direction = 0;
+            for(std::size_t i = 0; i < keys.size() and serves; ++i)
+            {
+                serves = i < equality ? contains(usage.equality, key_name(cols[i]))
+                    : same_name(key_name(cols[i]), key_name(keys[i]));
+                if(i >= equality and descending(cols[i]) == descending(keys[i]))
+                    ++same_direction;
+            }
+            if( ! usage.order.empty() and same_direction != 0 and same_direction != keys.size() - equality)
+                serves = false;
+            for(std::size_t i = keys.size(); i < index.size() and serves; ++i)
+                serves = std::any_of(cols.begin(), cols.end(), [&](const StringType &col) { return same_name(key_name(col), index[i]); });
+            if(serves)
+                return existing.first;
+        }
+
+        return StringType();
+    }
+
+    /**
+     * Reading indexes of the table
+     * Partial indexes are skipped, they serve only queries with conditions matching their WHERE
+     *
+     * @param  Connection connection database session
+     * @param  StringType table name of table, optionally with the schema
+     * @return Indexes key columns of each index, in order, descending with DESC suffix
+     */
+    IndexAdvisor::Indexes IndexAdvisor::_indexes(Connection &connection, const StringType &table)
+    {
+        using namespace Poco::Data;
+
+        Indexes res;
+        const auto qualified = SchemaCache::split(table);
+        const StringType pragma = qualified.first.empty() ? "PRAGMA " : "PRAGMA `" + qualified.first + "`.";
+        Statement list(connection.session);
+        list << pragma + "index_list(`" + qualified.second + "`);";
+        list.execute();
+        RecordSet names(list);
+        bool more = names.moveFirst();
+        while(more)
+        {
+            // Columns: seq, name, unique, origin, partial
+            if(names.columnCount() < 5 or names[4].convert<int>() == 0)
+                res[names[1].convert<StringType>()];
+            more = names.moveNext();
+        }
+        for(auto &index : res)
+        {
+            Statement info(connection.session);
+            info << pragma + "index_xinfo(`" + index.first + "`);";
+            info.execute();
+            RecordSet rs(info);
+            more = rs.moveFirst();
+            while(more)
+            {
+                // Columns: seqno, cid, name, desc, coll, key; columns after the key ones (rowid) are skipped
+                if(rs[5].convert<int>() != 0)
+                    index.second.push_back((rs[2].isEmpty() ? StringType() : rs[2].convert<StringType>())
+                        + (rs[3].convert<int>() != 0 ? " DESC" : ""));
+                more = rs.moveNext();
+            }
+        }
+
+        return res;
+    }
+} // End namespace DB
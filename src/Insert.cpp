@@ -0,0 +1,367 @@
+#include "Insert.h"
+#include "DBReflectionHelper.h"
+#include <algorithm>
+#include <cassert>
+
+namespace DB
+{
+    namespace
+    {
+        inline std::string& append_name(std::string &out, const std::string &name)
+        {
+            return out.append(1, '`').append(name).append(1, '`');
+        }
+    }
+
+    /**
+     * Borrowing session, the same way as Select does
+     *
+     * @param std::string table_name name of table
+     * @param std::string db_name name of database
+     */
+    Insert::Insert(const std::string &table_name, const std::string &db_name)
+        : _table_name(table_name), _db_name(db_name)
+    {
+        assert( ! table_name.empty());
+        _ses = SessionPool::get(db_name)->acquire();
+    }
+
+    /**
+     * Factory pattern
+     *
+     * @param std::string table_name name of table rows are inserted into
+     * @param std::string db_name name of database
+     */
+    Insert Insert::factory(const std::string &table_name, const std::string &db_name)
+    {
+        return Insert(table_name, db_name);
+    }
+
+    /**
+     * Add column filled by the rows
+     *
+     * @param  boost::string_ref column name of column
+     * @return Insert
+     */
+    Insert& Insert::columns(const boost::string_ref column)
+    {
+        assert(_rows.empty());
+        _columns.push_back(column.to_string());
+        return (*this);
+    }
+
+    /**
+     * Add columns filled by the rows
+     *
+     * @param  std::vector<std::string> cols names of columns
+     * @return Insert
+     */
+    Insert& Insert::columns(const std::vector<std::string> cols)
+    {
+        assert(_rows.empty());
+        _columns.insert(_columns.end(), cols.begin(), cols.end());
+        return (*this);
+    }
+
+    /**
+     * Add row, values are kept until execute()
+     *
+     * @param  Params row values of all columns, in order of columns()
+     * @return Insert
+     */
+    Insert& Insert::values(const Params &row)
+    {
+        assert(row.size() == _columns.size());
+        _rows.insert(_rows.end(), row.begin(), row.end());
+        return (*this);
+    }
+
+    /**
+     * Set what happens with rows violating a constraint (INSERT OR REPLACE, INSERT OR IGNORE)
+     *
+     * @param  CONFLICT action conflict resolution
+     * @return Insert
+     */
+    Insert& Insert::on_conflict(const CONFLICT action)
+    {
+        _conflict = action;
+        return (*this);
+    }
+
+    /**
+     * Update existing rows instead of failing: ON CONFLICT (keys) DO UPDATE SET col = excluded.col
+     * Requires SQLite 3.24 or newer
+     *
+     * @param  std::vector<std::string> keys columns of the unique index (conflict target)
+     * @param  std::vector<std::string> update columns set from the new row, empty - all columns but the keys
+     * @return Insert
+     */
+    Insert& Insert::upsert(const std::vector<std::string> keys, const std::vector<std::string> update)
+    {
+        assert( ! keys.empty());
+        _upsert_keys = keys;
+        _upsert_update = update;
+        return (*this);
+    }
+
+    /**
+     * Commit the transaction after given number of rows, so long imports don't keep one huge transaction
+     * Rows of already committed transactions stay in the table when a later statement fails
+     *
+     * @param  std::size_t rows rows per transaction, 0 - all rows in one transaction
+     * @return Insert
+     */
+    Insert& Insert::commit_every(const std::size_t rows)
+    {
+        _commit_every = rows;
+        return (*this);
+    }
+
+    /**
+     * Limit rows sent in one statement (it's always limited by MAX_VARIABLES too)
+     *
+     * @param  std::size_t rows rows per statement, 0 - no limit
+     * @return Insert
+     */
+    Insert& Insert::rows_per_statement(const std::size_t rows)
+    {
+        _rows_per_statement = rows;
+        return (*this);
+    }
+
+    /**
+     * Switch database to write-ahead log before inserting
+     * Journal mode is stored in the database file, so it stays for all sessions
+     *
+     * @param  bool wal use WAL journal
+     * @return Insert
+     */
+    Insert& Insert::journal_wal(const bool wal)
+    {
+        _wal = wal;
+        return (*this);
+    }
+
+    /**
+     * Set PRAGMA synchronous for the duration of execute(), previous value is restored afterwards
+     *
+     * @param  SYNCHRONOUS mode sync mode, OFF is the fastest but may lose transactions on power loss
+     * @return Insert
+     */
+    Insert& Insert::synchronous(const SYNCHRONOUS mode)
+    {
+        _synchronous = mode;
+        return (*this);
+    }
+
+    /**
+     * Statement inserting given number of rows
+     *
+     * @param  std::size_t rows number of rows in VALUES
+     * @return std::string statement with placeholders
+     */
+    std::string Insert::sql(const std::size_t rows) const
+    {
+        assert( ! _columns.empty() and rows > 0);
+        static const char *actions[] = {"INSERT INTO ", "INSERT OR IGNORE INTO ", "INSERT OR REPLACE INTO "};
+
+        std::string row(1, '(');
+        for(std::size_t i = 0; i < _columns.size(); ++i)
+            row.append(i != 0 ? ", ?" : "?");
+        row += ')';
+
+        std::string res;
+        res.reserve(64 + _table_name.size() + _columns.size() * 16 + rows * (row.size() + 2));
+        res.append(actions[static_cast<std::size_t>(_conflict)]).append(SchemaCache::quote(_table_name)).append(" (");
+        for(std::size_t i = 0; i < _columns.size(); ++i)
+            append_name(res.append(i != 0 ? ", " : ""), _columns[i]);
+        res.append(") VALUES ");
+        for(std::size_t i = 0; i < rows; ++i)
+            res.append(i != 0 ? ", " : "").append(row);
+
+        if( ! _upsert_keys.empty())
+        {
+            res.append(" ON CONFLICT (");
+            for(std::size_t i = 0; i < _upsert_keys.size(); ++i)
+                append_name(res.append(i != 0 ? ", " : ""), _upsert_keys[i]);
+            res += ')';
+            std::vector<std::string> update = _upsert_update;
+            if(update.empty())
+                for(const auto &col : _columns)
+                    if(std::find(_upsert_keys.begin(), _upsert_keys.end(), col) == _upsert_keys.end())
+                        update.push_back(col);
+            if(update.empty())
+                res.append(" DO NOTHING");
+            for(std::size_t i = 0; i < update.size(); ++i)
+                append_name(append_name(res.append(i != 0 ? ", " : " DO UPDATE SET "), update[i]).append(" = excluded."), update[i]);
+        }
+        res += ';';
+
+        return res;
+    }
+
+    /**
+     * Insert all added rows
+     * Rows are sent in statements of up to _chunk_rows() rows, inside transactions of commit_every() rows
+     * Cached results of the table are dropped, rows are removed from the builder on success
+     *
+     * @return std::size_t number of inserted rows
+     */
+    std::size_t Insert::execute()
+    {
+        using namespace Poco::Data;
+
+        const auto rows = size();
+        if(rows == 0)
+            return 0;
+        const auto width = _columns.size();
+        const auto chunk = _chunk_rows();
+        const auto previous_synchronous = _apply_pragmas();
+        std::size_t done = 0;
+        std::size_t uncommitted = 0;
+        std::size_t shape_rows = 0;
+        QueryShape shape;
+
+        _ses->session.begin();
+        try {
+            while(done < rows)
+            {
+                // Statement never crosses the commit boundary, so there are at most three shapes
+                auto count = std::min(chunk, rows - done);
+                if(_commit_every != 0)
+                    count = std::min(count, _commit_every - uncommitted);
+                if(count != shape_rows)
+                {
+                    shape.text = sql(count);
+                    shape_rows = count;
+                }
+                shape.params.assign(_rows.begin() + done * width, _rows.begin() + (done + count) * width);
+
+                QueryTrace trace(shape.text);
+                Statement &insert = _ses->statements.prepare(_ses->session, shape);
+                trace.mark(STAGE::PREPARE);
+                insert.execute();
+                QueryCounter::inc();
+                trace.mark(STAGE::EXECUTE);
+                trace.finish(count, 0);
+                SlowQueryLog::check(*_ses, shape, trace, count);
+
+                done += count;
+                uncommitted += count;
+                if(_commit_every != 0 and uncommitted == _commit_every and done < rows)
+                {
+                    _ses->session.commit();
+                    _ses->session.begin();
+                    uncommitted = 0;
+                }
+            }
+            _ses->session.commit();
+        }
+        catch(...) {
+            _ses->session.rollback();
+            _finish(previous_synchronous);
+            throw;
+        }
+        _finish(previous_synchronous);
+        _rows.clear();
+
+        return done;
+    }
+
+    /**
+     * Remove columns, rows and options
+     *
+     * @return Insert
+     */
+    Insert& Insert::clear()
+    {
+        _columns.clear();
+        _rows.clear();
+        _conflict = CONFLICT::ABORT;
+        _upsert_keys.clear();
+        _upsert_update.clear();
+        _commit_every = 0;
+        _rows_per_statement = 0;
+        _wal = false;
+        _synchronous = SYNCHRONOUS::DEFAULT;
+
+        return (*this);
+    }
+
+    /**
+     * Number of rows sent in one statement
+     *
+     * @return std::size_t rows per statement
+     */
+    std::size_t Insert::_chunk_rows() const
+    {
+        assert(_columns.size() <= MAX_VARIABLES);
+        auto res = MAX_VARIABLES / _columns.size();
+        if(_rows_per_statement != 0)
+            res = std::min(res, _rows_per_statement);
+
+        return std::max<std::size_t>(res, 1);
+    }
+
+    /**
+     * Setting journal mode and sync mode of the session
+     * Both are set per database, so rows inserted into attached database (schema.table) use its own modes
+     *
+     * @return int previous PRAGMA synchronous, -1 if it wasn't changed
+     */
+    int Insert::_apply_pragmas()
+    {
+        using namespace Poco::Data;
+        static const char *modes[] = {"", "OFF", "NORMAL", "FULL"};
+        const auto pragma = _pragma();
+
+        if(_wal)
+        {
+            std::string mode;
+            Statement journal(_ses->session);
+            journal << pragma + "journal_mode = WAL;", into(mode);
+            journal.execute();
+        }
+        if(_synchronous == SYNCHRONOUS::DEFAULT)
+            return -1;
+
+        int previous = -1;
+        Statement current(_ses->session);
+        current << pragma + "synchronous;", into(previous);
+        current.execute();
+        Statement sync(_ses->session);
+        sync << pragma + "synchronous = " + modes[static_cast<std::size_t>(_synchronous)] + ";";
+        sync.execute();
+
+        return previous;
+    }
+
+    /**
+     * Restoring sync mode of the pooled session and dropping cached results of the table
+     * Called after failures too, because rows of committed transactions are already in the table
+     *
+     * @param int previous_synchronous value returned by _apply_pragmas()
+     */
+    void Insert::_finish(const int previous_synchronous)
+    {
+        using namespace Poco::Data;
+
+        ResultCache::invalidate(_db_name, _table_name);
+        if(previous_synchronous < 0)
+            return;
+        Statement sync(_ses->session);
+        sync << _pragma() + "synchronous = " + std::to_string(previous_synchronous) + ";";
+        sync.execute();
+    }
+
+    /**
+     * Beginning of PRAGMA statement for the database of the table
+     *
+     * @return std::string "PRAGMA " or "PRAGMA `schema`."
+     */
+    std::string Insert::_pragma() const
+    {
+        const auto schema = SchemaCache::split(_table_name).first;
+        return schema.empty() ? std::string("PRAGMA ") : "PRAGMA `" + schema + "`.";
+    }
+} // End namespace DB
@@ -0,0 +1,97 @@
+#include "KeysetPager.h"
+#include <cassert>
+#include <algorithm>
+
+namespace DB
+{
+    /**
+     * Preparing pager, no query is executed until next()
+     *
+     * Limit and offset of the select are dropped, pages are limited by page_size and start after the last key
+     *
+     * @param Select select query sorted by unique keys (it's copied, so it can be changed afterwards)
+     * @param std::size_t page_size number of rows on the page
+     * @param StringType table_name name of table
+     */
+    KeysetPager::KeysetPager(const Select &select, const std::size_t page_size, const StringType &table_name)
+        : _select(select), _page_size(page_size), _table_name(table_name), _keys(select.order_keys())
+    {
+        assert(page_size > 0);
+        assert( ! _keys.empty());
+        _select.clear_limit().clear_offset();
+    }
+
+    /**
+     * Read the next page
+     * Page is read by columns, so keys of the last row keep their types and NULLs can be told from empty text
+     *
+     * @return false if there are no more rows
+     */
+    bool KeysetPager::next()
+    {
+        _page.clear();
+        if(_done)
+            return false;
+        const auto data = _select.seek(_last_key).limit(static_cast<unsigned long>(_page_size)).get_columnar(_table_name);
+        // Short page is the last one, so there is no need for another query
+        _done = data.rows() < _page_size;
+        if(data.rows() == 0)
+            return false;
+        _page.reserve(data.rows());
+        for(std::size_t row = 0; row < data.rows(); ++row)
+        {
+            Row tmp;
+            for(std::size_t col = 0; col < data.cols(); ++col)
+                tmp[data.names()[col]] = data.get(row, col);
+            _page.push_back(std::move(tmp));
+        }
+        _last_key.clear();
+        for(const auto &key : _keys)
+            _last_key.push_back(_value(data, key));
+
+        return true;
+    }
+
+    /**
+     * Continue reading after the row with given keys (i.e. stored from last_key())
+     *
+     * @param  Params last_key values of order keys, empty - start from the beginning
+     * @return KeysetPager
+     */
+    KeysetPager& KeysetPager::resume(const Params &last_key)
+    {
+        assert(last_key.empty() or last_key.size() == _keys.size());
+        _last_key = last_key;
+        _done = false;
+        return (*this);
+    }
+
+    /**
+     * Value of the order key in the last row, key may be qualified with table name (`Accounts`.`id`)
+     * Value is bound with type of the column, so keys without affinity (i.e. expressions) compare as in ORDER BY
+     *
+     * @param  ColumnarData data rows of the page
+     * @param  StringType key order key
+     * @return Param value of the key, NULL is kept as NULL (seek renders it as IS NULL)
+     */
+    Param KeysetPager::_value(const ColumnarData &data, const StringType &key) const
+    {
+        const auto &names = data.names();
+        auto it = std::find(names.begin(), names.end(), key);
+        if(it == names.end())
+            it = std::find(names.begin(), names.end(), Select::column_name(key));
+        assert(it != names.end());
+        const auto &column = data.column(static_cast<std::size_t>(it - names.begin()));
+        const auto row = data.rows() - 1;
+        if(column.is_null(row))
+            return Param();
+        switch(column.type())
+        {
+            case ColumnVector::TYPE::INTEGER: return Param(column.get_int(row));
+            case ColumnVector::TYPE::REAL: return Param(column.get_real(row));
+            case ColumnVector::TYPE::TEXT: break;
+        }
+
+        return Param(column.to_string(row));
+    }
+} // End namespace DB
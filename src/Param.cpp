@@ -0,0 +1,41 @@
+#include "Param.h"
+#include <sstream>
+#include "Poco/DateTimeFormatter.h"
+#include <iomanip>
+
+namespace DB
+{
+    /**
+     * Date is bound as text in SQLite format (YYYY-MM-DD HH:MM:SS), so it works with date functions
+     *
+     * @param Poco::DateTime val bound date
+     */
+    Param::Param(const Poco::DateTime &val)
+        : _type(TYPE::TEXT), _text(Poco::DateTimeFormatter::format(val, "%Y-%m-%d %H:%M:%S"))
+    {
+    }
+
+    /**
+     * Text representation of the value (for logs and cache keys)
+     *
+     * @return std::string value as text, blobs are shown as their size
+     */
+    std::string Param::to_string() const
+    {
+        switch(_type)
+        {
+            case TYPE::INTEGER: return std::to_string(_int);
+            case TYPE::REAL:
+            {
+                std::ostringstream out;
+                out << std::setprecision(17) << _real;
+                return out.str();
+            }
+            case TYPE::TEXT: return _text;
+            case TYPE::BLOB: return "<blob " + std::to_string(_blob.size()) + " B>";
+            case TYPE::NONE: return "NULL";
+        }
+
+        return std::string();
+    }
+} // End namespace DB
@@ -0,0 +1,265 @@
+#include "QueryMetrics.h"
+#include <sstream>
+
+namespace DB
+{
+    constexpr std::size_t LatencyHistogram::BUCKETS;
+    constexpr std::size_t QueryMetrics::STAGES;
+    const std::array<unsigned long, LatencyHistogram::BUCKETS - 1> LatencyHistogram::BOUNDS = {{
+        10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 100000, 1000000
+    }};
+
+    std::map<std::string, std::shared_ptr<QueryMetrics::Entry>> QueryMetrics::_entries;
+    std::mutex QueryMetrics::_mutex;
+    std::atomic<bool> QueryMetrics::_enabled(true);
+
+    namespace
+    {
+        const char *STAGE_NAMES[] = {"build", "prepare", "execute", "fetch", "convert"};
+
+        /// Escaping label value for Prometheus text format
+        std::string escape_label(const std::string &val)
+        {
+            std::string res;
+            res.reserve(val.size());
+            for(const char c : val)
+            {
+                if(c == '\\' or c == '"')
+                    res += '\\';
+                if(c == '\n')
+                    res += "\\n";
+                else
+                    res += c;
+            }
+
+            return res;
+        }
+    }
+
+    LatencyHistogram::LatencyHistogram() : _count(0), _sum_us(0)
+    {
+        for(auto &bucket : _buckets)
+            bucket.store(0);
+    }
+
+    /**
+     * Add single measurement
+     *
+     * @param std::chrono::microseconds duration measured time
+     */
+    void LatencyHistogram::record(const std::chrono::microseconds duration)
+    {
+        const auto us = static_cast<unsigned long>(duration.count());
+        std::size_t bucket = 0;
+        while(bucket < BOUNDS.size() and us > BOUNDS[bucket])
+            ++bucket;
+        _buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        _count.fetch_add(1, std::memory_order_relaxed);
+        _sum_us.fetch_add(us, std::memory_order_relaxed);
+    }
+
+    /**
+     * Current values of the counters
+     *
+     * @return Snapshot copy of the counters
+     */
+    LatencyHistogram::Snapshot LatencyHistogram::snapshot() const
+    {
+        Snapshot res;
+        for(std::size_t i = 0; i < BUCKETS; ++i)
+            res.buckets[i] = _buckets[i].load(std::memory_order_relaxed);
+        res.count = _count.load(std::memory_order_relaxed);
+        res.sum_us = _sum_us.load(std::memory_order_relaxed);
+
+        return res;
+    }
+
+    /**
+     * Counters of the query shape, created on first use
+     * Holders keep the counters alive when reset() drops them
+     *
+     * @param  std::string sql normalized query
+     * @return std::shared_ptr<Entry> counters
+     */
+    std::shared_ptr<QueryMetrics::Entry> QueryMetrics::_entry(const std::string &sql)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto &entry = _entries[sql];
+        if( ! entry)
+            entry = std::make_shared<Entry>();
+
+        return entry;
+    }
+
+    /**
+     * Record duration of the stage
+     *
+     * @param std::string sql normalized query
+     * @param STAGE stage measured stage
+     * @param std::chrono::microseconds duration measured time
+     */
+    void QueryMetrics::record(const std::string &sql, const STAGE stage, const std::chrono::microseconds duration)
+    {
+        if( ! _enabled)
+            return;
+        _entry(sql)->stages[static_cast<std::size_t>(stage)].record(duration);
+    }
+
+    /**
+     * Record finished execution of the query
+     *
+     * @param std::string sql normalized query
+     * @param unsigned long long rows number of rows returned
+     * @param unsigned long long bytes size of the values materialized
+     */
+    void QueryMetrics::record_execution(const std::string &sql, const unsigned long long rows, const unsigned long long bytes)
+    {
+        if( ! _enabled)
+            return;
+        const auto entry = _entry(sql);
+        entry->count.fetch_add(1, std::memory_order_relaxed);
+        entry->rows.fetch_add(rows, std::memory_order_relaxed);
+        entry->bytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    /**
+     * Current statistics of all query shapes
+     *
+     * @return std::vector<Snapshot> one entry per shape
+     */
+    std::vector<QueryMetrics::Snapshot> QueryMetrics::snapshot()
+    {
+        std::vector<Snapshot> res;
+        std::lock_guard<std::mutex> lock(_mutex);
+        res.reserve(_entries.size());
+        for(const auto &it : _entries)
+        {
+            Snapshot shape;
+            shape.sql = it.first;
+            shape.count = it.second->count.load(std::memory_order_relaxed);
+            shape.rows = it.second->rows.load(std::memory_order_relaxed);
+            shape.bytes = it.second->bytes.load(std::memory_order_relaxed);
+            for(std::size_t i = 0; i < STAGES; ++i)
+                shape.stages[i] = it.second->stages[i].snapshot();
+            res.push_back(shape);
+        }
+
+        return res;
+    }
+
+    /**
+     * Statistics in Prometheus text exposition format
+     *
+     * @return std::string metrics ready to be served on /metrics
+     */
+    std::string QueryMetrics::prometheus()
+    {
+        std::ostringstream out;
+        const auto shapes = snapshot();
+        out << "# TYPE db_queries_total counter\n";
+        for(const auto &shape : shapes)
+            out << "db_queries_total{query=\"" << escape_label(shape.sql) << "\"} " << shape.count << '\n';
+        out << "# TYPE db_rows_total counter\n";
+        for(const auto &shape : shapes)
+            out << "db_rows_total{query=\"" << escape_label(shape.sql) << "\"} " << shape.rows << '\n';
+        out << "# TYPE db_bytes_total counter\n";
+        for(const auto &shape : shapes)
+            out << "db_bytes_total{query=\"" << escape_label(shape.sql) << "\"} " << shape.bytes << '\n';
+        out << "# TYPE db_stage_seconds histogram\n";
+        for(const auto &shape : shapes)
+        {
+            const auto query = escape_label(shape.sql);
+            for(std::size_t stage = 0; stage < STAGES; ++stage)
+            {
+                const auto &hist = shape.stages[stage];
+                if(hist.count == 0)
+                    continue;
+                const auto labels = "query=\"" + query + "\",stage=\"" + STAGE_NAMES[stage] + "\"";
+                unsigned long cumulative = 0;
+                for(std::size_t i = 0; i < LatencyHistogram::BUCKETS; ++i)
+                {
+                    cumulative += hist.buckets[i];
+                    out << "db_stage_seconds_bucket{" << labels << ",le=\"";
+                    if(i < LatencyHistogram::BOUNDS.size())
+                        out << LatencyHistogram::BOUNDS[i] / 1e6;
+                    else
+                        out << "+Inf";
+                    out << "\"} " << cumulative << '\n';
+                }
+                out << "db_stage_seconds_sum{" << labels << "} " << hist.sum_us / 1e6 << '\n';
+                out << "db_stage_seconds_count{" << labels << "} " << hist.count << '\n';
+            }
+        }
+
+        return out.str();
+    }
+
+    /**
+     * Drop all collected statistics
+     * Queries running meanwhile finish recording into the dropped counters
+     */
+    void QueryMetrics::reset()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _entries.clear();
+    }
+
+    /**
+     * Start measuring the query
+     *
+     * @param std::string sql normalized query
+     */
+    QueryTrace::QueryTrace(const std::string &sql) : QueryTrace()
+    {
+        shape(sql);
+    }
+
+    /**
+     * Start measuring before the query is known
+     */
+    QueryTrace::QueryTrace() : _last(Clock::now())
+    {
+    }
+
+    /**
+     * Set the measured query, counters of the shape are looked up only once
+     *
+     * @param std::string sql normalized query
+     */
+    void QueryTrace::shape(const std::string &sql)
+    {
+        if(QueryMetrics::enabled())
+            _entry = QueryMetrics::_entry(sql);
+    }
+
+    /**
+     * Finish measuring the stage
+     *
+     * @param STAGE stage stage which just ended
+     */
+    void QueryTrace::mark(const STAGE stage)
+    {
+        const auto now = Clock::now();
+        const auto duration = std::chrono::duration_cast<std::chrono::microseconds>(now - _last);
+        _last = now;
+        _total += duration;
+        _stages[static_cast<std::size_t>(stage)] += duration;
+        if(_entry)
+            _entry->stages[static_cast<std::size_t>(stage)].record(duration);
+    }
+
+    /**
+     * Finish measuring the execution
+     *
+     * @param unsigned long long rows number of rows returned
+     * @param unsigned long long bytes size of the values materialized
+     */
+    void QueryTrace::finish(const unsigned long long rows, const unsigned long long bytes)
+    {
+        if( ! _entry)
+            return;
+        _entry->count.fetch_add(1, std::memory_order_relaxed);
+        _entry->rows.fetch_add(rows, std::memory_order_relaxed);
+        _entry->bytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+} // End namespace DB
@@ -0,0 +1,235 @@
+#include "ResultCache.h"
+#include <algorithm>
+
+namespace DB
+{
+    ResultCache::Config ResultCache::_config;
+    ResultCache::Entries ResultCache::_entries;
+    std::unordered_map<std::string, ResultCache::Entries::iterator> ResultCache::_index;
+    std::map<ResultCache::VersionKey, int> ResultCache::_data_versions;
+    std::size_t ResultCache::_memory = 0;
+    ResultCache::Stats ResultCache::_stats;
+    std::mutex ResultCache::_mutex;
+
+    namespace
+    {
+        /// Approximate memory used by the result (map nodes included)
+        std::size_t data_size(const CompiledQuery::Data &data)
+        {
+            std::size_t res = sizeof(data);
+            for(const auto &row : data)
+            {
+                res += sizeof(row);
+                for(const auto &cell : row)
+                    res += 64 + cell.first.size() + cell.second.size();
+            }
+
+            return res;
+        }
+    }
+
+    /**
+     * Set cache limits, cached entries are dropped
+     *
+     * @param Config config cache limits
+     */
+    void ResultCache::configure(const Config &config)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _config = config;
+        _entries.clear();
+        _index.clear();
+        _data_versions.clear();
+        _memory = 0;
+    }
+
+    /**
+     * Find cached result of the query
+     *
+     * @param  Connection connection session of the caller (used for PRAGMA data_version)
+     * @param  std::string db_name name of database
+     * @param  CompiledQuery query executed query
+     * @return cached data, null if there is no valid entry
+     */
+    std::shared_ptr<const ResultCache::Data> ResultCache::lookup(Connection &connection, const std::string &db_name, const CompiledQuery &query)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if(_config.check_data_version)
+        {
+            lock.unlock();
+            _check_data_version(connection, db_name);
+            lock.lock();
+        }
+
+        const auto key = _key(db_name, query);
+        auto it = _index.find(key);
+        if(it == _index.end())
+        {
+            ++_stats.misses;
+            return std::shared_ptr<const Data>();
+        }
+        if(it->second->expires < Clock::now())
+        {
+            _erase(it->second);
+            ++_stats.misses;
+            return std::shared_ptr<const Data>();
+        }
+        _entries.splice(_entries.begin(), _entries, it->second);
+        ++_stats.hits;
+
+        return _entries.front().data;
+    }
+
+    /**
+     * Put result of the query into the cache
+     *
+     * @param std::string db_name name of database
+     * @param CompiledQuery query executed query
+     * @param std::vector<std::string> tables tables read by the query
+     * @param Data data result of the query
+     * @param std::chrono::milliseconds ttl time after which entry expires
+     */
+    void ResultCache::store(const std::string &db_name, const CompiledQuery &query, const std::vector<std::string> &tables,
+        const Data &data, const std::chrono::milliseconds ttl)
+    {
+        Entry entry;
+        entry.key = _key(db_name, query);
+        entry.db_name = db_name;
+        entry.tables = tables;
+        entry.data = std::make_shared<const Data>(data);
+        entry.size = data_size(data) + entry.key.size();
+        entry.expires = Clock::now() + ttl;
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        if(entry.size > _config.memory_budget)
+            return;
+        auto it = _index.find(entry.key);
+        if(it != _index.end())
+            _erase(it->second);
+        while( ! _entries.empty() and _memory + entry.size > _config.memory_budget)
+        {
+            _erase(std::prev(_entries.end()));
+            ++_stats.evicted;
+        }
+        _memory += entry.size;
+        _entries.push_front(std::move(entry));
+        _index[_entries.front().key] = _entries.begin();
+    }
+
+    /**
+     * Drop all entries which read from the table
+     *
+     * @param std::string db_name name of database
+     * @param std::string table_name name of table, empty - all tables of the database
+     */
+    void ResultCache::invalidate(const std::string &db_name, const std::string &table_name)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _invalidate(db_name, table_name);
+    }
+
+    void ResultCache::_invalidate(const std::string &db_name, const std::string &table_name)
+    {
+        for(auto it = _entries.begin(); it != _entries.end(); )
+        {
+            const auto current = it++;
+            if(current->db_name != db_name)
+                continue;
+            if(table_name == std::string() or std::find(current->tables.begin(), current->tables.end(), table_name) != current->tables.end())
+                _erase(current);
+        }
+    }
+
+    /**
+     * Drop all entries
+     */
+    void ResultCache::clear()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _entries.clear();
+        _index.clear();
+        _data_versions.clear();
+        _memory = 0;
+    }
+
+    /**
+     * Usage statistics of the cache
+     *
+     * @return Stats snapshot of counters
+     */
+    ResultCache::Stats ResultCache::stats()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        Stats res = _stats;
+        res.entries = _entries.size();
+        res.memory = _memory;
+
+        return res;
+    }
+
+    /**
+     * Cache key: database, query text and values with their types
+     *
+     * @param  std::string db_name name of database
+     * @param  CompiledQuery query executed query
+     * @return std::string key
+     */
+    std::string ResultCache::_key(const std::string &db_name, const CompiledQuery &query)
+    {
+        std::string res;
+        res.reserve(db_name.size() + query.sql().size() + 16 * query.params().size() + 2);
+        res.append(db_name) += '\0';
+        res.append(query.sql()) += '\0';
+        for(const auto &param : query.params())
+        {
+            res += static_cast<char>('0' + static_cast<int>(param.type()));
+            res.append(param.to_string()) += '\0';
+        }
+
+        return res;
+    }
+
+    /**
+     * Drop entries of the database unless the caller's connection saw no changes since its last check
+     * The first check through the connection drops the entries as well, there's nothing to compare with.
+     * Changes made through the same connection are not reported by SQLite, use DB::invalidate() for them.
+     *
+     * @param Connection connection session of the caller
+     * @param std::string db_name name of database
+     */
+    void ResultCache::_check_data_version(Connection &connection, const std::string &db_name)
+    {
+        using namespace Poco::Data;
+
+        int version = 0;
+        Statement query(connection.session);
+        query << "PRAGMA data_version;", into(version);
+        query.execute();
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        const auto seen = _data_versions.emplace(VersionKey(db_name, connection.id), version);
+        if(seen.second or seen.first->second != version)
+        {
+            _invalidate(db_name, std::string());
+            seen.first->second = version;
+        }
+    }
+
+    void ResultCache::_erase(Entries::iterator it)
+    {
+        _memory -= it->size;
+        _index.erase(it->key);
+        _entries.erase(it);
+    }
+
+    /**
+     * Drop cached results which read from the table (i.e. after modifying it)
+     *
+     * @param std::string table_name name of table
+     * @param std::string db_name name of database
+     */
+    void invalidate(const std::string &table_name, const std::string &db_name)
+    {
+        ResultCache::invalidate(db_name, table_name);
+    }
+} // End namespace DB
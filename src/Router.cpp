@@ -0,0 +1,116 @@
+#include "Router.h"
+#include <algorithm>
+#include <cassert>
+
+namespace DB
+{
+    std::map<std::string, Router::Replicas> Router::_replicas;
+    std::mutex Router::_mutex;
+
+    /**
+     * URI opening copy of the database read-only
+     * immutable=1 also skips locking and change detection, so it's only for files nobody writes to
+     *
+     * @param  std::string file path of the copy
+     * @param  bool immutable file never changes while it's open
+     * @return std::string name of database used by the replica's session pool
+     */
+    std::string Router::replica_uri(const std::string &file, const bool immutable)
+    {
+        static const char hex[] = "0123456789ABCDEF";
+        std::string res("file:");
+        res.reserve(file.size() + 32);
+        for(const char c : file)
+        {
+            // Characters with special meaning in URI
+            if(c == '%' or c == '?' or c == '#')
+                res.append(1, '%').append(1, hex[static_cast<unsigned char>(c) >> 4]).append(1, hex[c & 0x0F]);
+            else
+                res += c;
+        }
+        res.append("?mode=ro");
+        if(immutable)
+            res.append("&immutable=1");
+
+        return res;
+    }
+
+    /**
+     * Register replica of the database
+     * Databases attached to the primary pool are not attached to replicas, use SessionPool::attach() with the replica
+     *
+     * @param std::string db_name name of primary database
+     * @param std::string replica name of the replica, i.e. returned by replica_uri()
+     */
+    void Router::add_replica(const std::string &db_name, const std::string &replica)
+    {
+        assert(replica != db_name);
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto &names = _replicas[db_name].names;
+        if(std::find(names.begin(), names.end(), replica) == names.end())
+            names.push_back(replica);
+    }
+
+    /**
+     * Send all reads of the database back to the primary
+     *
+     * @param std::string db_name name of primary database
+     */
+    void Router::remove_replicas(const std::string &db_name)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _replicas.erase(db_name);
+    }
+
+    /**
+     * Replicas of the database
+     *
+     * @param  std::string db_name name of primary database
+     * @return std::vector<std::string> names of replicas
+     */
+    std::vector<std::string> Router::replicas(const std::string &db_name)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _replicas.find(db_name);
+        return it != _replicas.end() ? it->second.names : std::vector<std::string>();
+    }
+
+    /**
+     * Choose database for the next read: replica with the fewest borrowed sessions
+     * Replicas are checked starting from the next one in turn, so equally busy replicas are used round-robin
+     *
+     * @param  std::string db_name name of primary database
+     * @return std::string name of replica, db_name if it has no replicas
+     */
+    std::string Router::route(const std::string &db_name)
+    {
+        std::vector<std::string> names;
+        std::size_t first = 0;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _replicas.find(db_name);
+            if(it == _replicas.end() or it->second.names.empty())
+                return db_name;
+            names = it->second.names;
+            first = it->second.next++ % names.size();
+        }
+
+        // Pools are checked without holding the lock, so the choice is only a hint under contention
+        std::size_t best = first;
+        std::size_t best_used = 0;
+        for(std::size_t i = 0; i < names.size(); ++i)
+        {
+            const auto index = (first + i) % names.size();
+            const auto used = SessionPool::get(names[index])->stats().used;
+            if(i == 0 or used < best_used)
+            {
+                best = index;
+                best_used = used;
+            }
+            if(best_used == 0)
+                break;
+        }
+
+        return names[best];
+    }
+} // End namespace DB
@@ -0,0 +1,177 @@
+#include "SchemaCache.h"
+#include "Poco/Data/RecordSet.h"
+
+namespace DB
+{
+    std::map<SchemaCache::Key, SchemaCache::TableInfo> SchemaCache::_tables;
+    std::chrono::milliseconds SchemaCache::_check_interval = std::chrono::seconds(1);
+    std::mutex SchemaCache::_mutex;
+
+    /**
+     * Get columns of the table, reading them from database only if needed
+     *
+     * @param  Connection connection session used if table info has to be read
+     * @param  std::string db_name name of database
+     * @param  std::string table_name name of table
+     * @return TableInfo columns of the table
+     */
+    SchemaCache::TableInfo SchemaCache::get(Connection &connection, const std::string &db_name, const std::string &table_name)
+    {
+        const Key key(db_name, table_name);
+        const auto now = Clock::now();
+        int version = 0;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _tables.find(key);
+            if(it != _tables.end() and now - it->second.checked < _check_interval)
+                return it->second;
+        }
+
+        // Entry is missing or should be checked against current schema
+        version = _schema_version(connection, split(table_name).first);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _tables.find(key);
+            if(it != _tables.end() and it->second.schema_version == version)
+            {
+                it->second.checked = now;
+                return it->second;
+            }
+            if(it != _tables.end())
+            {
+                // Schema has changed, so prepared statements may be invalid too
+                StatementCache::invalidate_all();
+                _tables.erase(it);
+            }
+        }
+
+        auto info = _load(connection, table_name);
+        info.schema_version = version;
+        info.checked = now;
+        std::lock_guard<std::mutex> lock(_mutex);
+        _tables[key] = info;
+
+        return info;
+    }
+
+    /**
+     * Drop cached info about the table (or about all tables of the database)
+     *
+     * @param std::string db_name name of database
+     * @param std::string table_name name of table, empty - all tables
+     */
+    void SchemaCache::invalidate(const std::string &db_name, const std::string &table_name)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if(table_name != std::string())
+        {
+            _tables.erase(Key(db_name, table_name));
+            return;
+        }
+        for(auto it = _tables.begin(); it != _tables.end(); )
+            it = it->first.first == db_name ? _tables.erase(it) : std::next(it);
+    }
+
+    /**
+     * Read columns of the tables up front (i.e. at application startup)
+     *
+     * @param std::string db_name name of database
+     * @param std::vector<std::string> tables names of tables
+     */
+    void SchemaCache::warm(const std::string &db_name, const std::vector<std::string> &tables)
+    {
+        auto connection = SessionPool::get(db_name)->acquire();
+        for(const auto &table : tables)
+            get(*connection, db_name, table);
+    }
+
+    /**
+     * Set how often cached entries are compared with schema_version
+     *
+     * @param std::chrono::milliseconds interval time between checks, 0 - check every time
+     */
+    void SchemaCache::set_check_interval(const std::chrono::milliseconds interval)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _check_interval = interval;
+    }
+
+    /**
+     * Split name of the table into the schema (attached database) and the table
+     *
+     * @param  std::string table_name name of table, optionally qualified: "archive.Users"
+     * @return std::pair<std::string, std::string> schema (empty if not qualified) and table
+     */
+    std::pair<std::string, std::string> SchemaCache::split(const std::string &table_name)
+    {
+        const auto dot = table_name.find('.');
+        if(dot == std::string::npos)
+            return std::make_pair(std::string(), table_name);
+
+        return std::make_pair(table_name.substr(0, dot), table_name.substr(dot + 1));
+    }
+
+    /**
+     * Name of the table quoted for SQL, schema is quoted separately: `archive`.`Users`
+     *
+     * @param  std::string table_name name of table, optionally qualified
+     * @return std::string quoted name
+     */
+    std::string SchemaCache::quote(const std::string &table_name)
+    {
+        const auto name = split(table_name);
+        if(name.first.empty())
+            return "`" + table_name + "`";
+
+        return "`" + name.first + "`.`" + name.second + "`";
+    }
+
+    /**
+     * Reading list of columns in table
+     *
+     * @param  Connection connection database session
+     * @param  std::string table_name name of table
+     * @return TableInfo columns of the table
+     */
+    SchemaCache::TableInfo SchemaCache::_load(Connection &connection, const std::string &table_name)
+    {
+        using namespace Poco::Data;
+
+        TableInfo info;
+        const auto name = split(table_name);
+        Statement cols(connection.session);
+        cols << std::string("PRAGMA ") + (name.first.empty() ? "" : "`" + name.first + "`.")
+            + "TABLE_INFO(`" + name.second + std::string("`);");
+        cols.execute();
+        RecordSet rs(cols);
+        bool more = rs.moveFirst();
+        while(more)
+        {
+            info.names.push_back(rs[1].convert<std::string>());
+            info.types.push_back(rs[2].convert<std::string>());
+            more = rs.moveNext();
+        }
+
+        return info;
+    }
+
+    /**
+     * Current schema version of the database, changed by SQLite on every schema modification
+     * Every attached database has its own version
+     *
+     * @param  Connection connection database session
+     * @param  std::string schema attached database, empty - main database
+     * @return int schema version
+     */
+    int SchemaCache::_schema_version(Connection &connection, const std::string &schema)
+    {
+        using namespace Poco::Data;
+
+        int version = 0;
+        Statement query(connection.session);
+        query << (schema.empty() ? std::string("PRAGMA schema_version;") : "PRAGMA `" + schema + "`.schema_version;"), into(version);
+        query.execute();
+
+        return version;
+    }
+} // End namespace DB
@@ -0,0 +1,293 @@
+#include "SessionPool.h"
+#include <vector>
+#include <cassert>
+#include "Poco/Exception.h"
+#include "Poco/Data/SQLite/Connector.h"
+
+namespace DB
+{
+    std::map<std::string, std::shared_ptr<SessionPool>> SessionPool::_pools;
+    SessionPool::Config SessionPool::_default_config;
+    std::mutex SessionPool::_pools_mutex;
+
+    namespace
+    {
+        /// Name of the Poco connector, registered before the first session is opened
+        const std::string& connector()
+        {
+            static const std::string name("SQLite");
+            register_connector();
+            return name;
+        }
+
+        std::atomic<unsigned long> last_connection_id(0);
+    }
+
+    /**
+     * Registering database connector, once per process (also when first sessions are opened concurrently)
+     */
+    void register_connector()
+    {
+        static std::once_flag registered;
+        std::call_once(registered, [] { Poco::Data::SQLite::Connector::registerConnector(); });
+    }
+
+    /**
+     * Opening session, connector is registered if needed
+     *
+     * @param std::string db_name name of database
+     */
+    Connection::Connection(const std::string &db_name) : session(connector(), db_name), id(++last_connection_id)
+    {
+    }
+
+    /**
+     * Attach databases missing in the session (ATTACH DATABASE file AS schema)
+     * Their tables are available as schema.table, also in joins with tables of the main database
+     *
+     * @param std::map<std::string, std::string> databases schema names and files
+     */
+    void Connection::attach(const std::map<std::string, std::string> &databases)
+    {
+        using namespace Poco::Data;
+
+        for(const auto &database : databases)
+        {
+            auto it = attached.find(database.first);
+            if(it != attached.end() and it->second == database.second)
+                continue;
+            if(it != attached.end())
+            {
+                session << "DETACH DATABASE `" + database.first + "`;", now;
+                attached.erase(it);
+            }
+            std::string file = database.second;
+            session << "ATTACH DATABASE ? AS `" + database.first + "`;", use(file), now;
+            attached[database.first] = database.second;
+        }
+    }
+
+    /**
+     * Creating pool and opening minimal number of sessions
+     *
+     * @param std::string db_name name of database used by sessions
+     * @param Config config pool limits
+     */
+    SessionPool::SessionPool(const std::string &db_name, const Config &config)
+        : _db_name(db_name), _config(config), _hits(0), _misses(0), _waits(0), _timeouts(0), _evicted(0)
+    {
+        for(std::size_t i = 0; i < _config.min_size; ++i)
+            _idle.push_back(Idle{new Connection(_db_name), Clock::now()});
+    }
+
+    /**
+     * Closing idle sessions
+     * Sessions which are still borrowed are closed by their handles
+     */
+    SessionPool::~SessionPool()
+    {
+        for(auto &idle : _idle)
+            delete idle.session;
+    }
+
+    /**
+     * Get pool for the database, creating it with default config if needed
+     *
+     * @param  std::string db_name name of database
+     * @return pool shared by all users of the database
+     */
+    std::shared_ptr<SessionPool> SessionPool::get(const std::string &db_name)
+    {
+        std::lock_guard<std::mutex> lock(_pools_mutex);
+        auto it = _pools.find(db_name);
+        if(it != _pools.end())
+            return it->second;
+        std::shared_ptr<SessionPool> pool(new SessionPool(db_name, _default_config));
+        _pools[db_name] = pool;
+
+        return pool;
+    }
+
+    /**
+     * Set limits for pool of the database
+     * Already open sessions are kept, new limits are used for the next checkouts
+     *
+     * @param std::string db_name name of database
+     * @param Config config pool limits
+     */
+    void SessionPool::configure(const std::string &db_name, const Config &config)
+    {
+        assert(config.max_size > 0 and config.min_size <= config.max_size);
+        auto pool = get(db_name);
+        std::lock_guard<std::mutex> lock(pool->_mutex);
+        pool->_config = config;
+        pool->_available.notify_all();
+    }
+
+    /**
+     * Set limits used for pools created later
+     *
+     * @param Config config pool limits
+     */
+    void SessionPool::set_default_config(const Config &config)
+    {
+        assert(config.max_size > 0 and config.min_size <= config.max_size);
+        std::lock_guard<std::mutex> lock(_pools_mutex);
+        _default_config = config;
+    }
+
+    /**
+     * Attach database to all sessions of the pool, sessions get it on their next checkout
+     * Handles which are already borrowed (i.e. by a Select) don't see it until they are acquired again
+     *
+     * @param std::string db_name name of main database
+     * @param std::string schema name used in queries: schema.table
+     * @param std::string file attached database
+     */
+    void SessionPool::attach(const std::string &db_name, const std::string &schema, const std::string &file)
+    {
+        assert( ! schema.empty() and schema.find('.') == std::string::npos);
+        auto pool = get(db_name);
+        std::lock_guard<std::mutex> lock(pool->_mutex);
+        pool->_config.attached[schema] = file;
+    }
+
+    /**
+     * Dropping all pools (i.e. before connector shutdown)
+     */
+    void SessionPool::shutdown_all()
+    {
+        std::lock_guard<std::mutex> lock(_pools_mutex);
+        _pools.clear();
+    }
+
+    /**
+     * Borrow session from the pool, with all configured databases attached
+     * Waits up to checkout_timeout when all sessions are in use
+     *
+     * @return session handle, returned to the pool on destruction
+     */
+    SessionPool::SessionPtr SessionPool::acquire()
+    {
+        std::vector<std::unique_ptr<Connection>> expired;
+        std::unique_lock<std::mutex> lock(_mutex);
+        _collect_expired(expired);
+        if(_idle.empty() and _used >= _config.max_size)
+        {
+            ++_waits;
+            const bool ready = _available.wait_for(lock, _config.checkout_timeout,
+                [this] { return ! _idle.empty() or _used < _config.max_size; });
+            if( ! ready)
+            {
+                ++_timeouts;
+                throw Poco::TimeoutException("No free session in pool", _db_name);
+            }
+        }
+
+        Connection *session = nullptr;
+        const auto attached = _config.attached;
+        ++_used;
+        if( ! _idle.empty())
+        {
+            session = _idle.back().session;
+            _idle.pop_back();
+            ++_hits;
+        }
+        else
+        {
+            // Opening file takes a while, so don't block other users
+            lock.unlock();
+            try {
+                session = new Connection(_db_name);
+            }
+            catch(...) {
+                lock.lock();
+                --_used;
+                _available.notify_one();
+                throw;
+            }
+            ++_misses;
+        }
+        if(lock.owns_lock())
+            lock.unlock();
+
+        std::weak_ptr<SessionPool> pool = shared_from_this();
+        SessionPtr res(session, [pool](Connection *ses) {
+            if(auto owner = pool.lock())
+                owner->_release(ses);
+            else
+                delete ses;
+        });
+        // Session goes back to the pool if attaching fails
+        res->attach(attached);
+
+        return res;
+    }
+
+    /**
+     * Give session back to the pool
+     *
+     * @param Connection session returned session
+     */
+    void SessionPool::_release(Connection *session)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        --_used;
+        if(session->session.isConnected() and _idle.size() + _used < _config.max_size)
+            _idle.push_back(Idle{session, Clock::now()});
+        else
+        {
+            lock.unlock();
+            delete session;
+            lock.lock();
+        }
+        _available.notify_one();
+    }
+
+    /**
+     * Close sessions idle for longer than configured time
+     */
+    void SessionPool::evict_idle()
+    {
+        std::vector<std::unique_ptr<Connection>> expired;
+        std::lock_guard<std::mutex> lock(_mutex);
+        _collect_expired(expired);
+    }
+
+    /**
+     * Move expired sessions out of the pool, so they can be closed without holding the lock
+     * Oldest sessions are at the front, pool never shrinks below min_size
+     *
+     * @param expired container receiving sessions to close
+     */
+    void SessionPool::_collect_expired(std::vector<std::unique_ptr<Connection>> &expired)
+    {
+        const auto deadline = Clock::now() - _config.idle_time;
+        while( ! _idle.empty() and _idle.size() + _used > _config.min_size and _idle.front().since < deadline)
+        {
+            expired.emplace_back(_idle.front().session);
+            _idle.pop_front();
+            ++_evicted;
+        }
+    }
+
+    /**
+     * Usage statistics of the pool
+     *
+     * @return Stats snapshot of counters
+     */
+    SessionPool::Stats SessionPool::stats() const
+    {
+        Stats res;
+        res.hits = _hits;
+        res.misses = _misses;
+        res.waits = _waits;
+        res.timeouts = _timeouts;
+        res.evicted = _evicted;
+        std::lock_guard<std::mutex> lock(_mutex);
+        res.idle = _idle.size();
+        res.used = _used;
+
+        return res;
+    }
+} // End namespace DB
@@ -0,0 +1,162 @@
+#include "SlowQueryLog.h"
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include "Poco/Data/RecordSet.h"
+
+namespace DB
+{
+    std::atomic<long long> SlowQueryLog::_threshold_us(-1);
+    SlowQueryLog::Sink SlowQueryLog::_sink = [](const SlowQueryLog::Entry &entry) {
+        std::cerr << SlowQueryLog::format(entry) << std::endl;
+    };
+    std::map<std::string, std::string> SlowQueryLog::_plans;
+    std::mutex SlowQueryLog::_mutex;
+
+    namespace
+    {
+        const char *STAGE_NAMES[] = {"build", "prepare", "execute", "fetch", "convert"};
+    }
+
+    /**
+     * Log queries slower than the threshold
+     *
+     * @param std::chrono::microseconds threshold minimal logged execution time
+     */
+    void SlowQueryLog::set_threshold(const std::chrono::microseconds threshold)
+    {
+        _threshold_us = threshold.count();
+    }
+
+    /**
+     * Stop logging
+     */
+    void SlowQueryLog::disable()
+    {
+        _threshold_us = -1;
+    }
+
+    /**
+     * Set consumer of the log entries (called on the thread which executed the query)
+     *
+     * @param Sink sink log consumer
+     */
+    void SlowQueryLog::set_sink(const Sink &sink)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _sink = sink;
+    }
+
+    /**
+     * Write log entries to the stream, one entry per line
+     *
+     * @param std::ostream out log stream (must outlive the logger)
+     */
+    void SlowQueryLog::set_stream(std::ostream &out)
+    {
+        set_sink([&out](const Entry &entry) { out << format(entry) << std::endl; });
+    }
+
+    /**
+     * Entry as a single line of text
+     *
+     * @param  Entry entry logged execution
+     * @return std::string log line
+     */
+    std::string SlowQueryLog::format(const Entry &entry)
+    {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(3);
+        out << "[slow query] " << entry.total.count() / 1000.0 << " ms (";
+        for(std::size_t stage = 0; stage < entry.stages.size(); ++stage)
+            if(entry.stages[stage].count() != 0)
+                out << STAGE_NAMES[stage] << ' ' << entry.stages[stage].count() / 1000.0 << " ms, ";
+        out << "rows " << entry.rows << ") " << entry.sql << " [";
+        for(std::size_t i = 0; i < entry.params.size(); ++i)
+            out << (i != 0 ? ", " : "") << entry.params[i].to_string();
+        out << "]";
+        if(entry.plan != std::string())
+            out << " plan: " << entry.plan;
+
+        return out.str();
+    }
+
+    /**
+     * Log execution of the query if it was slow
+     *
+     * @param Connection connection session which executed the query (used for EXPLAIN)
+     * @param QueryShape shape executed query with its values
+     * @param QueryTrace trace measured stages
+     * @param unsigned long long rows number of rows returned
+     */
+    void SlowQueryLog::check(Connection &connection, const QueryShape &shape, const QueryTrace &trace, const unsigned long long rows)
+    {
+        const auto threshold = _threshold_us.load(std::memory_order_relaxed);
+        if(threshold < 0 or trace.total().count() < threshold)
+            return;
+
+        Entry entry;
+        entry.sql = shape.text;
+        entry.params = shape.params;
+        entry.rows = rows;
+        entry.total = trace.total();
+        for(std::size_t stage = 0; stage < entry.stages.size(); ++stage)
+            entry.stages[stage] = trace.stage(static_cast<STAGE>(stage));
+
+        bool explained = false;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _plans.find(shape.text);
+            if(it != _plans.end())
+            {
+                entry.plan = it->second;
+                explained = true;
+            }
+        }
+        if( ! explained)
+        {
+            try {
+                entry.plan = explain(connection, shape);
+            }
+            catch(const std::exception &e) {
+                entry.plan = std::string("EXPLAIN failed: ") + e.what();
+            }
+            std::lock_guard<std::mutex> lock(_mutex);
+            _plans[shape.text] = entry.plan;
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _sink(entry);
+    }
+
+    /**
+     * Reading query plan chosen by SQLite
+     *
+     * @param  Connection connection database session
+     * @param  QueryShape shape query with its values
+     * @return std::string plan steps separated with " | "
+     */
+    std::string SlowQueryLog::explain(Connection &connection, const QueryShape &shape)
+    {
+        using namespace Poco::Data;
+
+        Statement explain(connection.session);
+        explain << "EXPLAIN QUERY PLAN " + shape.text;
+        for(const auto &param : shape.params)
+            explain, use(param);
+        explain.execute();
+        RecordSet rs(explain);
+        std::string res;
+        bool more = rs.moveFirst();
+        while(more)
+        {
+            if(res != std::string())
+                res += " | ";
+            // Description of the step is always the last column
+            res += rs[rs.columnCount() - 1].convert<std::string>();
+            more = rs.moveNext();
+        }
+
+        return res;
+    }
+} // End namespace DB
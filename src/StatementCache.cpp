@@ -0,0 +1,269 @@
+#include "StatementCache.h"
+#include "DBReflectionHelper.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cerrno>
+#include <cassert>
+
+namespace DB
+{
+    std::atomic<unsigned long> StatementCache::_global_generation(0);
+    std::atomic<std::size_t> StatementCache::_default_capacity(64);
+
+    namespace
+    {
+        bool is_ident_char(const char c)
+        {
+            return std::isalnum(static_cast<unsigned char>(c)) or c == '_' or c == '$';
+        }
+
+        /// Copy quoted part of the query (identifier or literal) without changes
+        std::size_t skip_quoted(const std::string &query, std::size_t pos, const char close)
+        {
+            for(++pos; pos < query.size(); ++pos)
+            {
+                if(query[pos] != close)
+                    continue;
+                // Doubled quote is an escaped one
+                if(pos + 1 < query.size() and query[pos + 1] == close and close != ']')
+                    ++pos;
+                else
+                    return pos + 1;
+            }
+
+            return pos;
+        }
+    }
+
+    /**
+     * Replace string and numeric literals in the query with placeholders
+     * Existing placeholders keep their values from bound, so values are ordered like placeholders in the text.
+     * Numbers in ORDER BY/GROUP BY are left untouched, because they are column ordinals there.
+     * Literals which can't be placeholders stay too: alias after AS ('x') and arguments of type name (VARCHAR(10)).
+     *
+     * @param  std::string query SQL query
+     * @param  Params bound values of placeholders already present in the query
+     * @return QueryShape normalized text with all values
+     */
+    QueryShape normalize(const std::string &query, const Params &bound)
+    {
+        QueryShape res;
+        res.text.reserve(query.size());
+        res.params.reserve(bound.size());
+        auto next_bound = bound.begin();
+        std::string prev_word, word;
+        bool ordinals = false; /// Are we inside ORDER BY/GROUP BY?
+        bool after_as = false; /// Previous token is AS, alias or type name follows
+        bool type_name = false; /// Previous token is name of the type (after AS), its arguments may follow
+        std::size_t type_args = 0; /// Depth of parentheses with arguments of the type
+
+        for(std::size_t pos = 0; pos < query.size(); )
+        {
+            const char c = query[pos];
+            if(c == '\'')
+            {
+                const auto end = skip_quoted(query, pos, '\'');
+                std::string val;
+                for(auto i = pos + 1; i + 1 < end; ++i)
+                {
+                    val += query[i];
+                    if(query[i] == '\'')
+                        ++i;
+                }
+                // Blob literals (X'..') and aliases stay in the text
+                if(after_as or type_args != 0 or ( ! res.text.empty() and (res.text.back() == 'x' or res.text.back() == 'X')
+                    and (res.text.size() == 1 or ! is_ident_char(res.text[res.text.size() - 2]))))
+                    res.text.append(query, pos, end - pos);
+                else
+                {
+                    res.text += '?';
+                    res.params.emplace_back(val);
+                }
+                after_as = type_name = false;
+                pos = end;
+            }
+            else if(c == '"' or c == '`' or c == '[')
+            {
+                const auto end = skip_quoted(query, pos, c == '[' ? ']' : c);
+                res.text.append(query, pos, end - pos);
+                after_as = type_name = false;
+                pos = end;
+            }
+            else if(c == '-' and pos + 1 < query.size() and query[pos + 1] == '-')
+            {
+                const auto end = std::min(query.find('\n', pos), query.size());
+                res.text.append(query, pos, end - pos);
+                pos = end;
+            }
+            else if(c == '/' and pos + 1 < query.size() and query[pos + 1] == '*')
+            {
+                const auto end = std::min(query.find("*/", pos + 2), query.size() - 2) + 2;
+                res.text.append(query, pos, end - pos);
+                pos = end;
+            }
+            else if(c == '?')
+            {
+                assert(next_bound != bound.end());
+                res.text += c;
+                if(next_bound != bound.end())
+                    res.params.push_back(*next_bound++);
+                after_as = type_name = false;
+                ++pos;
+            }
+            else if((std::isdigit(static_cast<unsigned char>(c))
+                     or (c == '.' and pos + 1 < query.size() and std::isdigit(static_cast<unsigned char>(query[pos + 1]))))
+                    and (pos == 0 or ! is_ident_char(query[pos - 1])))
+            {
+                auto end = pos;
+                bool real = false;
+                const bool hex = c == '0' and pos + 1 < query.size() and (query[pos + 1] == 'x' or query[pos + 1] == 'X');
+                if(hex)
+                    for(end += 2; end < query.size() and std::isxdigit(static_cast<unsigned char>(query[end])); ++end);
+                else
+                {
+                    for(; end < query.size() and std::isdigit(static_cast<unsigned char>(query[end])); ++end);
+                    if(end < query.size() and query[end] == '.')
+                        for(real = true, ++end; end < query.size() and std::isdigit(static_cast<unsigned char>(query[end])); ++end);
+                    if(end < query.size() and (query[end] == 'e' or query[end] == 'E'))
+                    {
+                        auto exp = end + 1;
+                        if(exp < query.size() and (query[exp] == '+' or query[exp] == '-'))
+                            ++exp;
+                        if(exp < query.size() and std::isdigit(static_cast<unsigned char>(query[exp])))
+                            for(real = true, end = exp; end < query.size() and std::isdigit(static_cast<unsigned char>(query[end])); ++end);
+                    }
+                }
+                const std::string num = query.substr(pos, end - pos);
+                errno = 0;
+                // SQLite reads zero-prefixed numbers as decimal, not octal
+                const long long ival = real ? 0 : std::strtoll(num.c_str(), nullptr, hex ? 16 : 10);
+                if(ordinals or after_as or type_args != 0 or (end < query.size() and is_ident_char(query[end])) or errno == ERANGE)
+                    res.text += num;
+                else
+                {
+                    res.text += '?';
+                    if(real)
+                        res.params.emplace_back(std::strtod(num.c_str(), nullptr));
+                    else
+                        res.params.emplace_back(ival);
+                }
+                after_as = type_name = false;
+                pos = end;
+            }
+            else if(is_ident_char(c))
+            {
+                auto end = pos;
+                for(; end < query.size() and is_ident_char(query[end]); ++end);
+                word = query.substr(pos, end - pos);
+                std::transform(word.begin(), word.end(), word.begin(), ::toupper);
+                if(word == "BY" and (prev_word == "ORDER" or prev_word == "GROUP"))
+                    ordinals = true;
+                else if(word == "WHERE" or word == "HAVING" or word == "LIMIT" or word == "OFFSET" or word == "SELECT"
+                        or word == "FROM" or word == "JOIN" or word == "ON" or word == "UNION")
+                    ordinals = false;
+                prev_word = word;
+                type_name = after_as;
+                after_as = word == "AS";
+                res.text.append(query, pos, end - pos);
+                pos = end;
+            }
+            else
+            {
+                if(c == '(' and (type_name or type_args != 0))
+                    ++type_args;
+                else if(c == ')' and type_args != 0)
+                    --type_args;
+                if( ! std::isspace(static_cast<unsigned char>(c)))
+                    after_as = type_name = false;
+                res.text += query[pos++];
+            }
+        }
+
+        return res;
+    }
+
+    /**
+     * Creating empty cache
+     *
+     * @param std::size_t capacity max number of kept statements
+     */
+    StatementCache::StatementCache(const std::size_t capacity)
+        : _capacity(capacity), _generation(_global_generation)
+    {
+        assert(capacity > 0);
+    }
+
+    /**
+     * Get statement prepared for the shape of query, with current values bound
+     * Least recently used statement is dropped when cache is full
+     *
+     * @param  Poco::Data::Session session session owning this cache
+     * @param  QueryShape shape normalized query
+     * @return statement ready for execution
+     */
+    Poco::Data::Statement& StatementCache::prepare(Poco::Data::Session &session, const QueryShape &shape)
+    {
+        using namespace Poco::Data;
+
+        if(_generation != _global_generation)
+            invalidate();
+
+        auto it = _index.find(shape.text);
+        if(it != _index.end())
+        {
+            StatementCounter::hit();
+            _entries.splice(_entries.begin(), _entries, it->second);
+            auto &entry = _entries.front();
+            // Same shape means the same number of placeholders, bindings refer to these objects
+            std::copy(shape.params.begin(), shape.params.end(), entry.params.begin());
+            return entry.statement;
+        }
+
+        StatementCounter::miss();
+        if(_entries.size() >= _capacity)
+        {
+            _index.erase(_entries.back().key);
+            _entries.pop_back();
+        }
+        _entries.emplace_front(session, shape.text);
+        auto &entry = _entries.front();
+        entry.params = shape.params;
+        entry.statement << shape.text;
+        for(const auto &param : entry.params)
+            entry.statement, use(param);
+        _index[shape.text] = _entries.begin();
+
+        return entry.statement;
+    }
+
+    /**
+     * Drop all statements of this session (i.e. after schema change)
+     */
+    void StatementCache::invalidate()
+    {
+        _index.clear();
+        _entries.clear();
+        _generation = _global_generation;
+    }
+
+    /**
+     * Drop statements in all sessions
+     * Caches are cleared lazily, when they are used next time
+     */
+    void StatementCache::invalidate_all()
+    {
+        ++_global_generation;
+    }
+
+    /**
+     * Set capacity of caches created later
+     *
+     * @param std::size_t capacity max number of statements per session
+     */
+    void StatementCache::set_default_capacity(const std::size_t capacity)
+    {
+        assert(capacity > 0);
+        _default_capacity = capacity;
+    }
+} // End namespace DB
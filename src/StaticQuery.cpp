@@ -0,0 +1,28 @@
+#include "StaticQuery.h"
+#include "DBReflectionHelper.h"
+
+namespace DB
+{
+    /**
+     * Executing the query using statement prepared on the session
+     *
+     * @param  Connection connection database session
+     * @param  QueryShape shape query with values of its placeholders
+     * @param  QueryTrace trace receives timings of prepare, execute and fetch stages
+     * @return rows of the result
+     */
+    std::unique_ptr<Poco::Data::RecordSet> StaticQuery::execute(Connection &connection, const QueryShape &shape, QueryTrace &trace)
+    {
+        using namespace Poco::Data;
+
+        Statement &select = connection.statements.prepare(connection.session, shape);
+        trace.mark(STAGE::PREPARE);
+        select.execute();
+        QueryCounter::inc();
+        trace.mark(STAGE::EXECUTE);
+        std::unique_ptr<RecordSet> res(new RecordSet(select));
+        trace.mark(STAGE::FETCH);
+
+        return res;
+    }
+} // End namespace DB